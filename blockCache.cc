@@ -0,0 +1,80 @@
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include "blockCache.hh"
+#include "helper.hh"
+
+mips_op_kind getOpKind(mips_op op) {
+  static const mips_op_kind kinds[] = {
+#define ITEM(X,K) mips_op_kind::K,
+    MIPS_OP_LIST(ITEM)
+#undef ITEM
+  };
+  return kinds[static_cast<size_t>(op)];
+}
+
+const char *getOpName(mips_op op) {
+  static const char *names[] = {
+#define ITEM(X,K) #X,
+    MIPS_OP_LIST(ITEM)
+#undef ITEM
+  };
+  return names[static_cast<size_t>(op)];
+}
+
+blockCache::blockCache() : n_lookups(0), n_fast_misses(0),
+			   code_pages(1UL << (32 - lg_code_page), false) {
+  memset(fast, 0, sizeof(fast));
+}
+
+blockCache::~blockCache() {
+  flush();
+}
+
+void blockCache::insert(mips_block *b) {
+  auto it = blocks.find(b->pc);
+  if(it != blocks.end()) {
+    delete it->second;
+  }
+  blocks[b->pc] = b;
+  fast[fast_index(b->pc)] = b;
+  const uint32_t last = b->pc + 4*(b->insns.size() - 1);
+  for(uint32_t p = b->pc >> lg_code_page; p <= (last >> lg_code_page); p++) {
+    code_pages[p] = true;
+  }
+}
+
+void blockCache::flush() {
+  for(auto &p : blocks) {
+    delete p.second;
+  }
+  blocks.clear();
+  memset(fast, 0, sizeof(fast));
+  std::fill(code_pages.begin(), code_pages.end(), false);
+}
+
+/* the page holds code, so look for a block the store overlaps */
+void blockCache::store_into_code(uint32_t ea, uint32_t sz) const {
+  for(const auto &p : blocks) {
+    const mips_block *b = p.second;
+    if((ea < (b->pc + 4*b->insns.size())) and ((ea + sz) > b->pc)) {
+      std::cerr << KRED << "store to 0x" << std::hex << ea
+		<< " overwrites the block decoded at 0x" << b->pc
+		<< std::dec << ", self-modifying code is not supported"
+		<< KNRM << "\n";
+      die();
+    }
+  }
+}
+
+std::ostream &operator<<(std::ostream &out, const blockCache &bc) {
+  uint64_t n_insns = 0;
+  for(const auto &p : bc.blocks) {
+    n_insns += p.second->insns.size();
+  }
+  out << bc.blocks.size() << " decoded blocks, "
+      << n_insns << " decoded insns, "
+      << bc.n_lookups << " lookups, "
+      << bc.n_fast_misses << " fast-path misses\n";
+  return out;
+}
@@ -0,0 +1,197 @@
+#ifndef __BLOCK_CACHE_HH__
+#define __BLOCK_CACHE_HH__
+
+#include <cstdint>
+#include <vector>
+#include <unordered_map>
+#include <ostream>
+
+#include "state.hh"
+
+/* every instruction class the predecoder understands.
+ * seq ops fall through, br ops have a delay slot and
+ * end a block, term ops end a block without one */
+#define MIPS_OP_LIST(OP)			\
+  OP(sll, seq)					\
+  OP(srl, seq)					\
+  OP(sra, seq)					\
+  OP(sllv, seq)					\
+  OP(srlv, seq)					\
+  OP(srav, seq)					\
+  OP(movci, seq)				\
+  OP(monitor, term)				\
+  OP(jr, br)					\
+  OP(jalr, br)					\
+  OP(syscall, term)				\
+  OP(break_, term)				\
+  OP(sync, seq)					\
+  OP(mfhi, seq)					\
+  OP(mthi, seq)					\
+  OP(mflo, seq)					\
+  OP(mtlo, seq)					\
+  OP(mult, seq)					\
+  OP(multu, seq)				\
+  OP(div, seq)					\
+  OP(divu, seq)					\
+  OP(add, seq)					\
+  OP(addu, seq)					\
+  OP(sub, seq)					\
+  OP(subu, seq)					\
+  OP(and_, seq)					\
+  OP(or_, seq)					\
+  OP(xor_, seq)					\
+  OP(nor, seq)					\
+  OP(slt, seq)					\
+  OP(sltu, seq)					\
+  OP(movn, seq)					\
+  OP(movz, seq)					\
+  OP(teq, seq)					\
+  OP(rtype_unknown, term)			\
+  OP(special2, seq)				\
+  OP(special3, seq)				\
+  OP(j, br)					\
+  OP(jal, br)					\
+  OP(coproc0, seq)				\
+  OP(coproc1, seq)				\
+  OP(coproc1x, seq)				\
+  OP(coproc2, term)				\
+  OP(bltz, br)					\
+  OP(bgez, br)					\
+  OP(bltzl, br)					\
+  OP(bgezl, br)					\
+  OP(beq, br)					\
+  OP(bne, br)					\
+  OP(blez, br)					\
+  OP(bgtz, br)					\
+  OP(beql, br)					\
+  OP(bnel, br)					\
+  OP(blezl, br)					\
+  OP(bgtzl, br)					\
+  OP(bc1f, br)					\
+  OP(bc1t, br)					\
+  OP(bc1fl, br)					\
+  OP(bc1tl, br)					\
+  OP(addiu, seq)				\
+  OP(slti, seq)					\
+  OP(sltiu, seq)				\
+  OP(andi, seq)					\
+  OP(ori, seq)					\
+  OP(xori, seq)					\
+  OP(lui, seq)					\
+  OP(lb, seq)					\
+  OP(lh, seq)					\
+  OP(lwl, seq)					\
+  OP(lw, seq)					\
+  OP(lbu, seq)					\
+  OP(lhu, seq)					\
+  OP(lwr, seq)					\
+  OP(sb, seq)					\
+  OP(sh, seq)					\
+  OP(swl, seq)					\
+  OP(sw, seq)					\
+  OP(sc, seq)					\
+  OP(swr, seq)					\
+  OP(lwc1, seq)					\
+  OP(ldc1, seq)					\
+  OP(swc1, seq)					\
+  OP(sdc1, seq)					\
+  OP(itype_unknown, term)
+
+enum class mips_op : uint8_t {
+#define ITEM(X,K) X,
+  MIPS_OP_LIST(ITEM)
+#undef ITEM
+  num_ops
+};
+
+enum class mips_op_kind : uint8_t {seq, br, term};
+
+struct decoded_insn;
+typedef void (*mips_handler)(const decoded_insn *, state_t *);
+/* a block translated by the jit */
+typedef void (*mips_native)(state_t *);
+
+/* an instruction with its fields pulled out at decode time.
+ * imm holds the sign-extended immediate (zero-extended for the
+ * logical ops, pre-shifted for lui) or the absolute target
+ * for branches and jumps */
+struct decoded_insn {
+  mips_handler handler;
+  uint32_t inst;
+  int32_t imm;
+  mips_op op;
+  uint8_t rs;
+  uint8_t rt;
+  uint8_t rd;
+  uint8_t sa;
+};
+
+struct mips_block {
+  uint32_t pc;
+  /* instructions issued by the block loop, i.e. all
+   * of them except a trailing delay slot */
+  uint32_t n_issue;
+  std::vector<decoded_insn> insns;
+  /* the two most recently seen successor blocks */
+  mips_block *succ[2];
+  /* entries counted towards the jit threshold */
+  uint32_t n_execs;
+  mips_native native;
+  mips_block(uint32_t pc) : pc(pc), n_issue(0), succ{nullptr, nullptr},
+			    n_execs(0), native(nullptr) {}
+};
+
+mips_op_kind getOpKind(mips_op op);
+const char *getOpName(mips_op op);
+
+class blockCache {
+private:
+  static const uint32_t lg_fast_entries = 12;
+  std::unordered_map<uint32_t, mips_block*> blocks;
+  /* direct-mapped front end for the hash table */
+  mips_block *fast[1U<<lg_fast_entries];
+  uint64_t n_lookups, n_fast_misses;
+  /* pages holding a decoded instruction */
+  static const uint32_t lg_code_page = 12;
+  std::vector<bool> code_pages;
+  static uint32_t fast_index(uint32_t pc) {
+    return (pc >> 2) & ((1U<<lg_fast_entries)-1);
+  }
+  void store_into_code(uint32_t ea, uint32_t sz) const;
+public:
+  blockCache();
+  ~blockCache();
+  mips_block *lookup(uint32_t pc) {
+    n_lookups++;
+    mips_block *b = fast[fast_index(pc)];
+    if(b and (b->pc == pc)) {
+      return b;
+    }
+    n_fast_misses++;
+    auto it = blocks.find(pc);
+    if(it == blocks.end()) {
+      return nullptr;
+    }
+    fast[fast_index(pc)] = it->second;
+    return it->second;
+  }
+  void insert(mips_block *b);
+  void flush();
+  /* blocks are never invalidated, so the simulator doesn't
+   * support self-modifying code and dies on a store over a
+   * decoded instruction. stores are aligned, so one never
+   * crosses into another page */
+  void check_store(uint32_t ea, uint32_t sz) const {
+    if(code_pages[ea >> lg_code_page]) {
+      store_into_code(ea, sz);
+    }
+  }
+  size_t size() const {
+    return blocks.size();
+  }
+  friend std::ostream &operator<<(std::ostream &out, const blockCache &bc);
+};
+
+std::ostream &operator<<(std::ostream &out, const blockCache &bc);
+
+#endif
@@ -0,0 +1,129 @@
+#include <cstdlib>
+#include <sstream>
+#include "branchTargetBuffer.hh"
+
+#define PAIR(X) {#X, branch_target_buffer::btb_repl::X},
+const std::map<std::string, branch_target_buffer::btb_repl> branch_target_buffer::btb_repl_map = {
+  BTB_REPL_LIST(PAIR)
+};
+#undef PAIR
+
+bool btb_config::parse(const std::string &spec) {
+  spec_pairs kvs;
+  if(not(splitSpec(spec, nullptr, kvs))) {
+    return false;
+  }
+  for(const auto &kv : kvs) {
+    const std::string &key = kv.first, &v = kv.second;
+    bool ok = true;
+    if(key == "lg_entries") {
+      ok = parseNumber(v, lg_entries);
+    }
+    else if(key == "ways") {
+      ok = parseNumber(v, ways);
+    }
+    else if(key == "tag_bits") {
+      ok = parseNumber(v, tag_bits);
+    }
+    else if(key == "repl") {
+      repl = v;
+    }
+    else {
+      return false;
+    }
+    if(not(ok)) {
+      return false;
+    }
+  }
+  return valid();
+}
+
+bool btb_config::valid() const {
+  if(ways == 0 or (ways & (ways - 1)) or lg_entries > 24 or
+     (1U << lg_entries) < ways or tag_bits == 0 or tag_bits > 30) {
+    return false;
+  }
+  return branch_target_buffer::btb_repl_map.count(repl) != 0;
+}
+
+std::string btb_config::str() const {
+  std::stringstream ss;
+  ss << "lg_entries=" << lg_entries
+     << ",ways=" << ways
+     << ",tag_bits=" << tag_bits
+     << ",repl=" << repl;
+  return ss.str();
+}
+
+branch_target_buffer::branch_target_buffer(const btb_config &c, uint64_t &icnt) :
+  cfg(c), repl(btb_repl_map.at(c.repl)), icnt(icnt) {
+  lg_sets = c.lg_entries - __builtin_ctz(c.ways);
+  entries.assign(1UL << c.lg_entries, btb_entry{0,0,0,false});
+}
+
+branch_target_buffer::btb_entry *branch_target_buffer::victim(btb_entry *set) {
+  btb_entry *v = set;
+  for(uint32_t w = 0; w < cfg.ways; w++) {
+    if(not(set[w].valid)) {
+      return &set[w];
+    }
+    if(set[w].stamp < v->stamp) {
+      v = &set[w];
+    }
+  }
+  if(repl == btb_repl::random) {
+    v = &set[rng.next() & (cfg.ways - 1)];
+  }
+  n_evictions++;
+  return v;
+}
+
+bool branch_target_buffer::access(uint32_t pc, uint32_t target, bool taken, bool direct) {
+  const uint32_t p = pc >> 2;
+  const uint32_t tag = (p >> lg_sets) & ((1U << cfg.tag_bits) - 1);
+  btb_entry *set = &entries[(p & ((1U << lg_sets) - 1)) * cfg.ways];
+  n_lookups++;
+  clock++;
+  for(uint32_t w = 0; w < cfg.ways; w++) {
+    btb_entry &e = set[w];
+    if(e.valid and (e.tag == tag)) {
+      n_hits++;
+      if(repl == btb_repl::lru) {
+	e.stamp = clock;
+      }
+      if(taken and (e.target != target)) {
+	e.target = target;
+	if(direct) {
+	  n_wrong_target++;
+	  miss_map[pc]++;
+	}
+	return not(direct);
+      }
+      return true;
+    }
+  }
+  /* fetch falls through a branch it doesn't know about, which is
+   * only wrong when the branch was taken */
+  if(not(taken)) {
+    n_untaken_misses++;
+    return true;
+  }
+  n_misses++;
+  miss_map[pc]++;
+  btb_entry *v = victim(set);
+  *v = btb_entry{tag, target, clock, true};
+  return false;
+}
+
+std::ostream &operator<<(std::ostream &out, const branch_target_buffer &b) {
+  out << "btb : " << b.cfg.str() << "\n";
+  out << b.n_lookups << " lookups, " << b.n_hits << " hits, "
+      << b.n_misses << " misses, " << b.n_untaken_misses
+      << " not-taken misses, " << b.n_wrong_target << " wrong targets, "
+      << b.n_evictions << " evictions\n";
+  out << 1000.0 * (static_cast<double>(b.n_misses) / b.icnt)
+      << " btb misses per kilo insn\n";
+  out << 1000.0 * (static_cast<double>(b.n_wrong_target) / b.icnt)
+      << " btb wrong targets per kilo insn\n";
+  return out;
+}
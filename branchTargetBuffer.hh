@@ -0,0 +1,79 @@
+#ifndef __BRANCH_TARGET_BUFFER_HH__
+#define __BRANCH_TARGET_BUFFER_HH__
+
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "helper.hh"
+
+#define BTB_REPL_LIST(BA) \
+  BA(lru)		  \
+  BA(fifo)		  \
+  BA(random)
+
+/* btb geometry, written as key=value[,key=value...], e.g.
+ * "lg_entries=11,ways=2,repl=fifo" */
+struct btb_config {
+  uint32_t lg_entries = 12;
+  uint32_t ways = 4;
+  /* tag bits above the set index. fewer than the pc has lets
+   * branches alias, which shows up as wrong targets */
+  uint32_t tag_bits = 16;
+  std::string repl = "lru";
+  bool parse(const std::string &spec);
+  bool valid() const;
+  std::string str() const;
+};
+
+/* set-associative buffer of taken branch and jump targets. every
+ * branch looks itself up; a taken one that misses is a front-end
+ * redirect even when its direction was predicted, and is then
+ * inserted. a hit with a stale target (an alias) is counted apart
+ * from misses */
+class branch_target_buffer {
+public:
+#define ITEM(X) X,
+  enum class btb_repl {
+    BTB_REPL_LIST(ITEM)
+  };
+#undef ITEM
+  static const std::map<std::string, btb_repl> btb_repl_map;
+private:
+  struct btb_entry {
+    uint32_t tag;
+    uint32_t target;
+    /* last use for lru, insertion for fifo */
+    uint64_t stamp;
+    bool valid;
+  };
+  btb_config cfg;
+  btb_repl repl;
+  uint32_t lg_sets = 0;
+  std::vector<btb_entry> entries;
+  uint64_t clock = 0;
+  xorshift32 rng;
+  uint64_t &icnt;
+  uint64_t n_lookups = 0, n_hits = 0, n_misses = 0;
+  /* misses on not-taken branches, which cost nothing */
+  uint64_t n_untaken_misses = 0;
+  uint64_t n_wrong_target = 0, n_evictions = 0;
+  /* redirects by pc, both misses and wrong targets */
+  std::map<uint32_t, uint64_t> miss_map;
+  btb_entry *victim(btb_entry *set);
+public:
+  branch_target_buffer(const btb_config &c, uint64_t &icnt);
+  /* looks up pc and trains on where it went. true when fetch
+   * would have followed it without a redirect. returns and other
+   * register jumps take their target from the rsb or the indirect
+   * predictor, so for them (direct false) a hit is enough */
+  bool access(uint32_t pc, uint32_t target, bool taken, bool direct = true);
+  const std::map<uint32_t, uint64_t> &getMap() const {
+    return miss_map;
+  }
+  friend std::ostream &operator<<(std::ostream &, const branch_target_buffer &);
+};
+
+#endif
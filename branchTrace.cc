@@ -0,0 +1,118 @@
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "branchTrace.hh"
+#include "helper.hh"
+
+branchTraceWriter::branchTraceWriter(const std::string &fname) :
+  fname(fname), fp(nullptr), buf(new uint8_t[buf_sz]), len(0),
+  last_pc(0), last_icnt(0), n_records(0), n_bytes(0) {
+  fp = fopen(fname.c_str(), "wb");
+  if(fp == nullptr) {
+    std::cerr << KRED << "unable to open trace " << fname << KNRM << "\n";
+    exit(-1);
+  }
+  const uint32_t hdr[2] = {trace_magic, trace_version};
+  if(fwrite(hdr, sizeof(hdr), 1, fp) != 1) {
+    die();
+  }
+  n_bytes = sizeof(hdr);
+}
+
+branchTraceWriter::~branchTraceWriter() {
+  if(fp) {
+    drain();
+    fclose(fp);
+  }
+  delete [] buf;
+}
+
+void branchTraceWriter::drain() {
+  if(len == 0) {
+    return;
+  }
+  if(fwrite(buf, 1, len, fp) != len) {
+    std::cerr << KRED << "short write to trace " << fname << KNRM << "\n";
+    exit(-1);
+  }
+  n_bytes += len;
+  len = 0;
+}
+
+void branchTraceWriter::close(uint64_t icnt) {
+  if(fp == nullptr) {
+    return;
+  }
+  if((len + max_record_sz) > buf_sz) {
+    drain();
+  }
+  buf[len++] = static_cast<uint8_t>(branch_kind::end);
+  putVarint(icnt - last_icnt);
+  drain();
+  fclose(fp);
+  fp = nullptr;
+}
+
+branchTraceReader::branchTraceReader(const std::string &fname) :
+  fname(fname), base(nullptr), sz(0) {
+  int fd = open(fname.c_str(), O_RDONLY);
+  if(fd == -1) {
+    std::cerr << KRED << "unable to open trace " << fname << KNRM << "\n";
+    exit(-1);
+  }
+  struct stat st;
+  if(fstat(fd, &st) != 0) {
+    die();
+  }
+  sz = st.st_size;
+  uint32_t hdr[2] = {0};
+  if(sz >= sizeof(hdr)) {
+    void *p = mmap(nullptr, sz, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(p == MAP_FAILED) {
+      die();
+    }
+    base = reinterpret_cast<uint8_t*>(p);
+    memcpy(hdr, base, sizeof(hdr));
+    madvise(base, sz, MADV_SEQUENTIAL);
+  }
+  close(fd);
+  if((hdr[0] != branchTraceWriter::trace_magic) or
+     (hdr[1] != branchTraceWriter::trace_version)) {
+    std::cerr << KRED << fname << " is not a branch trace" << KNRM << "\n";
+    exit(-1);
+  }
+  cur = begin();
+}
+
+branchTraceReader::~branchTraceReader() {
+  if(base) {
+    munmap(base, sz);
+  }
+}
+
+branchTraceCursor branchTraceReader::begin() const {
+  return branchTraceCursor(base + 2*sizeof(uint32_t), base + sz);
+}
+
+std::vector<branchTraceCursor> branchTraceReader::split(uint64_t n_records) const {
+  std::vector<branchTraceCursor> cursors;
+  branchTraceCursor c = begin();
+  branch_record r;
+  cursors.push_back(c);
+  for(uint64_t i = 1; c.next(r); i++) {
+    if((i % n_records) == 0) {
+      cursors.push_back(c);
+    }
+  }
+  return cursors;
+}
+
+void branchTraceCursor::truncated() const {
+  std::cerr << KRED << "branch trace is truncated" << KNRM << "\n";
+  exit(-1);
+}
@@ -0,0 +1,162 @@
+#ifndef __BRANCH_TRACE_HH__
+#define __BRANCH_TRACE_HH__
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/* control-flow events captured by --trace_out. jal and jalr
+ * push pc+8 onto the return stack, jr $31 is a return and any
+ * other jr is a plain indirect jump */
+enum class branch_kind : uint8_t {
+  cond, jump, call, icall, ret, indirect, end
+};
+
+/* one event as handed to the writer or recovered by a reader.
+ * icnt counts every instruction retired up to and including
+ * the branch itself (its delay slot goes with the next event) */
+struct branch_record {
+  uint32_t pc;
+  uint32_t target;
+  uint64_t icnt;
+  branch_kind kind;
+  bool taken;
+};
+
+/* records are delta encoded against the previous one :
+ *   header byte : kind in bits 0-2, taken in bit 3
+ *   varint      : zigzag((pc - previous pc) / 4)
+ *   varint      : zigzag((target - pc) / 4)
+ *   varint      : icnt - previous icnt
+ * a trace opens with trace_magic and trace_version and closes
+ * with an end record that carries only the final icnt delta */
+class branchTraceWriter {
+private:
+  static const size_t buf_sz = 1UL<<20;
+  std::string fname;
+  FILE *fp;
+  uint8_t *buf;
+  size_t len;
+  uint32_t last_pc;
+  uint64_t last_icnt;
+  uint64_t n_records;
+  uint64_t n_bytes;
+  void drain();
+  void putVarint(uint64_t x) {
+    while(x >= 0x80) {
+      buf[len++] = static_cast<uint8_t>(x) | 0x80;
+      x >>= 7;
+    }
+    buf[len++] = static_cast<uint8_t>(x);
+  }
+  static uint64_t zigzag(int32_t x) {
+    return (static_cast<uint32_t>(x) << 1) ^ static_cast<uint32_t>(x >> 31);
+  }
+public:
+  static const uint32_t trace_magic = 0x52544242;
+  static const uint32_t trace_version = 1;
+  /* largest encoding of a single record */
+  static const size_t max_record_sz = 1 + 5 + 5 + 10;
+  branchTraceWriter(const std::string &fname);
+  ~branchTraceWriter();
+  void record(uint32_t pc, uint32_t target, branch_kind kind,
+	      bool taken, uint64_t icnt) {
+    if((len + max_record_sz) > buf_sz) {
+      drain();
+    }
+    buf[len++] = static_cast<uint8_t>(kind) | (taken ? 8 : 0);
+    putVarint(zigzag(static_cast<int32_t>(pc - last_pc) >> 2));
+    putVarint(zigzag(static_cast<int32_t>(target - pc) >> 2));
+    putVarint(icnt - last_icnt);
+    last_pc = pc;
+    last_icnt = icnt;
+    n_records++;
+  }
+  /* writes the end record and closes the file */
+  void close(uint64_t icnt);
+  uint64_t records() const {
+    return n_records;
+  }
+  uint64_t bytes() const {
+    return n_bytes;
+  }
+};
+
+/* decodes records from some point in a mapped trace. cursors
+ * are cheap to copy, so several threads can walk one mapping */
+class branchTraceCursor {
+private:
+  const uint8_t *ptr, *end;
+  uint32_t last_pc;
+  uint64_t last_icnt;
+  void truncated() const;
+  uint64_t getVarint() {
+    uint64_t x = 0;
+    for(int shift = 0; ; shift += 7) {
+      if(ptr == end) {
+	truncated();
+      }
+      uint8_t b = *ptr++;
+      x |= static_cast<uint64_t>(b & 0x7f) << shift;
+      if(b < 0x80) {
+	break;
+      }
+    }
+    return x;
+  }
+  static uint32_t unzigzag(uint64_t x) {
+    return static_cast<uint32_t>(x >> 1) ^ -static_cast<uint32_t>(x & 1);
+  }
+public:
+  branchTraceCursor(const uint8_t *ptr = nullptr, const uint8_t *end = nullptr) :
+    ptr(ptr), end(end), last_pc(0), last_icnt(0) {}
+  /* instructions retired before the next record */
+  uint64_t icnt() const {
+    return last_icnt;
+  }
+  /* returns false at the end record, which leaves the
+   * final instruction count in r.icnt */
+  bool next(branch_record &r) {
+    if(ptr == end) {
+      truncated();
+    }
+    uint8_t h = *ptr++;
+    r.kind = static_cast<branch_kind>(h & 7);
+    r.taken = (h & 8) != 0;
+    if(r.kind == branch_kind::end) {
+      /* stay on the end record */
+      const uint8_t *p = ptr - 1;
+      r.icnt = last_icnt + getVarint();
+      ptr = p;
+      return false;
+    }
+    last_pc += unzigzag(getVarint()) << 2;
+    r.pc = last_pc;
+    r.target = r.pc + (unzigzag(getVarint()) << 2);
+    last_icnt += getVarint();
+    r.icnt = last_icnt;
+    return true;
+  }
+};
+
+/* maps a trace written by branchTraceWriter */
+class branchTraceReader {
+private:
+  std::string fname;
+  uint8_t *base;
+  size_t sz;
+  branchTraceCursor cur;
+public:
+  branchTraceReader(const std::string &fname);
+  ~branchTraceReader();
+  bool next(branch_record &r) {
+    return cur.next(r);
+  }
+  branchTraceCursor begin() const;
+  /* one cursor per n_records records, found with a
+   * decode-only pass over the whole trace */
+  std::vector<branchTraceCursor> split(uint64_t n_records) const;
+};
+
+#endif
@@ -1,10 +1,17 @@
 #define KEEP_BPRED_IMPL_IMPL
 #include "branch_predictor.hh"
-#include "globals.hh"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <sstream>
+#if defined(__AVX2__) || defined(__SSSE3__)
+#include <immintrin.h>
+#endif
 
 branch_predictor::branch_predictor(uint64_t &icnt):
-  icnt(icnt), n_branches(0), n_mispredicts(0), old_gbl_hist(0) {}
+  icnt(icnt), bhr(nullptr), n_branches(0), n_mispredicts(0), old_gbl_hist(0) {}
 
 void branch_predictor::get_stats(uint64_t &n_br,
 				 uint64_t &n_mis,
@@ -21,29 +28,46 @@ uberhistory::uberhistory(uint64_t &icnt, uint32_t lg_history_entries) :
 }
 
 uberhistory::~uberhistory() {
-  size_t used = pht.size();
-  std::cout << used << " valid entries in history table\n";
+  delete pht;
+}
+
+void uberhistory::report(std::ostream &out) const {
+  size_t used = pht ? pht->size() : 0;
+  out << used << " valid entries in history table\n";
+}
+
+void uberhistory::set_history(sim_history *h) {
+  branch_predictor::set_history(h);
+  /* 32 bits of pc, then the history */
+  uint64_t n_bits = 32 + h->size();
+  key.assign((n_bits + 63) / 64, 0);
+  delete pht;
+  pht = new wide_hash<uint8_t>(key.size());
 }
 
 bool uberhistory::predict(uint32_t addr, uint64_t &idx)  {
   idx = 0;
-  sim_bitvec &h = *globals::bhr;
-  std::stringstream ss;
-  ss << std::hex << (addr>>2) << std::dec;
-  
-  sidx = ss.str() + h.as_string();
-  
-  return pht[sidx] > 1;
+  const uint64_t n_hist = bhr->size();
+  /* bits 0..31 share the first word with the pc */
+  uint64_t lo = bhr->recent(std::min<uint64_t>(32, n_hist));
+  key[0] = (addr >> 2) | (lo << 32);
+  for(uint64_t w = 1, b = 32; w < key.size(); w++, b += 64) {
+    uint64_t v = bhr->window(b);
+    uint64_t left = n_hist - b;
+    key[w] = (left >= 64) ? v : (v & ((1UL << left) - 1));
+  }
+  ctr = &(*pht)[key.data()];
+  return *ctr > 1;
 }
 
 void uberhistory::update(uint32_t addr, uint64_t idx, bool prediction, bool taken) {
   bool mispredict = prediction != taken;
 
-  int32_t h = static_cast<int32_t>(pht[sidx]);
+  int32_t h = static_cast<int32_t>(*ctr);
   h = taken ? h+1 : h-1;
   h = std::min(3, h);
   h = std::max(0, h);
-  pht[sidx] = h;
+  *ctr = h;
   n_branches++;
   if(mispredict) {
     n_mispredicts++;
@@ -62,165 +86,418 @@ gshare::~gshare() {
   delete pht;
 }
 
-tage::tage(uint64_t &icnt, uint32_t lg_pht_entries) :
+/* n history lengths from lo to hi in a geometric series, each
+ * at least one longer than the last */
+std::vector<uint32_t> geometric_lengths(uint32_t n, uint32_t lo, uint32_t hi) {
+  std::vector<uint32_t> lens(n);
+  const double ratio = static_cast<double>(hi) / lo;
+  for(uint32_t t = 0; t < n; t++) {
+    double x = (n == 1) ? 0.0 : static_cast<double>(t) / (n - 1);
+    lens[t] = static_cast<uint32_t>(lo * std::pow(ratio, x) + 0.5);
+    if((t != 0) and (lens[t] <= lens[t-1])) {
+      lens[t] = lens[t-1] + 1;
+    }
+  }
+  return lens;
+}
+
+tage::tage(uint64_t &icnt, const bpred_config &c) :
   branch_predictor(icnt),
-  lg_pht_entries(lg_pht_entries){
+  lg_pht_entries(c.lg_pht_sz),
+  lg_u_period(c.tage_lg_u_period),
+  alloc_max(c.tage_alloc) {
 
   pht = new twobit_counter_array(1U<<lg_pht_entries);
-  
-  for(int h = 0; h < tage::n_tables; h++) {
-    tage_tables[h] = new tage_entry[1U<<lg_pht_entries];
-    for(size_t i = 0; i < (1U<<lg_pht_entries); i++) {
-      tage_tables[h][i].clear();
+
+  const uint32_t n = c.tage_tables;
+  std::vector<uint32_t> lens = geometric_lengths(n, c.tage_min_hist, c.tage_max_hist);
+  tables.resize(n);
+  for(uint32_t t = 0; t < n; t++) {
+    tage_table &tt = tables[t];
+    tt.hist_len = lens[t];
+    tt.lg_sz = c.tage_lg_sz[t];
+    tt.tag_bits = c.tage_tag_bits[t];
+    tt.entries.resize(1U << tt.lg_sz);
+    for(tage_entry &e : tt.entries) {
+      e.ctr = 0;
+      e.u = 0;
+      e.tag = 0;
     }
   }
-  
+  pred_table.resize(n+1, 0);
+  corr_pred_table.resize(n+1, 0);
 }
 
 tage::~tage() {
   delete pht;
-  for(int h = 0; h < tage::n_tables; h++) {
-    delete [] tage_tables[h];
-  }
-  for(int h = 0; h <= tage::n_tables; h++) {
-    double f = (static_cast<double>(corr_pred_table[h]) / pred_table[h]) * 100.0;
-    std::cout << f << " percent correct "
+}
+
+void tage::report(std::ostream &out) const {
+  for(size_t h = 0; h < pred_table.size(); h++) {
+    double f = (pred_table[h] == 0) ? 100.0 :
+      (static_cast<double>(corr_pred_table[h]) / pred_table[h]) * 100.0;
+    out << f << " percent correct "
 	      << pred_table[h] << " predictions, "
 	      << corr_pred_table[h] << " correct from table len "
-	      << ((h==0) ? 0 : table_lengths[h-1]) << "\n";
+	      << ((h==0) ? 0 : tables[h-1].hist_len) << "\n";
   }
 }
 
-bool tage::predict(uint32_t addr, uint64_t & idx) {
-  bool hit = false, prediction = false;
-
-  uint32_t addr_hash = pc_hash(addr);
-  //std::cout << globals::bhr->as_string() << "\n";
-  
-  for(int h = 0; h < tage::n_tables; h++) {
-    uint64_t hash = 0;
-    hash = globals::bhr->xor_fold(tage::table_lengths[h]);
-    //hash = globals::bhr->hash(tage::table_lengths[h]);
-    hash ^= (addr << 2);
-    hash &= (1UL << lg_pht_entries) - 1;
-    hashes[h] = hash;
-    pred_valid[h] = false;
+void tage::set_history(sim_history *h) {
+  branch_predictor::set_history(h);
+  for(tage_table &tt : tables) {
+    tt.fold_idx = h->add_fold(tt.hist_len, tt.lg_sz);
+    tt.fold_tag0 = h->add_fold(tt.hist_len, tt.tag_bits);
+    tt.fold_tag1 = h->add_fold(tt.hist_len, tt.tag_bits - 1);
   }
+}
 
+bool tage::predict(uint32_t addr, uint64_t & idx) {
+  const uint32_t pc = addr >> 2;
+  const int n = static_cast<int>(tables.size());
+  provider = alt_provider = -1;
+  for(int t = n-1; t >= 0; t--) {
+    tage_table &tt = tables[t];
+    tt.idx = (pc ^ (pc >> tt.lg_sz) ^ bhr->fold(tt.fold_idx)) & ((1U << tt.lg_sz) - 1);
+    tt.tag = (pc ^ bhr->fold(tt.fold_tag0) ^ (bhr->fold(tt.fold_tag1) << 1)) &
+      ((1U << tt.tag_bits) - 1);
+    if(tt.entries[tt.idx].tag == tt.tag) {
+      if(provider < 0) {
+	provider = t;
+      }
+      else if(alt_provider < 0) {
+	alt_provider = t;
+      }
+    }
+  }
+  base_idx = pc & ((1U << lg_pht_entries) - 1);
+  bool base_pred = pht->get_value(base_idx) > 1;
+  alt_pred = (alt_provider < 0) ? base_pred :
+    (tables[alt_provider].entries[tables[alt_provider].idx].ctr >= 0);
+  if(provider < 0) {
+    idx = 0;
+    return base_pred;
+  }
+  int8_t ctr = tables[provider].entries[tables[provider].idx].ctr;
+  provider_pred = ctr >= 0;
+  provider_weak = (ctr == 0) or (ctr == -1);
+  idx = provider + 1;
+  if(provider_weak and (use_alt_on_na >= 0)) {
+    return alt_pred;
+  }
+  return provider_pred;
+}
 
-  for(int h = 0; h < tage::n_tables; h++)  {
-    if(tage_tables[h][hashes[h]].tag == addr_hash) {
-      pred[h] = (tage_tables[h][hashes[h]].pred > 1);
+/* claims up to alloc_max entries with no useful bits in tables
+ * longer than the provider, or ages them if there are none */
+void tage::allocate(uint32_t addr, bool taken) {
+  const int n = static_cast<int>(tables.size());
+  int start = provider + 1;
+  /* sometimes skip a table so two branches don't keep evicting
+   * each other from the same one */
+  if(((start + 1) < n) and ((rng.next() & 3) == 0)) {
+    start++;
+  }
+  uint32_t n_alloc = 0;
+  for(int t = start; (t < n) and (n_alloc < alloc_max); t++) {
+    tage_entry &e = tables[t].entries[tables[t].idx];
+    if(e.u == 0) {
+      e.tag = tables[t].tag;
+      e.ctr = taken ? 0 : -1;
+      n_alloc++;
+      t++;
     }
   }
-  
-  for(int h = 0; h < tage::n_tables; h++)  {
-    bool tag_match = tage_tables[h][hashes[h]].tag == addr_hash;
-    if(tag_match) {
-      idx = (static_cast<uint64_t>(h+1) << 32) | hashes[h];
-      prediction = (tage_tables[h][hashes[h]].pred > 1);
-      hit = true;
-      break;
+  if(n_alloc == 0) {
+    for(int t = start; t < n; t++) {
+      tage_entry &e = tables[t].entries[tables[t].idx];
+      e.u = (e.u == 0) ? 0 : (e.u - 1);
     }
   }
-  
-  //missed tagged tables, provide prediction from pht
-  if(hit == false) {
-    idx = addr_hash & ((1UL << lg_pht_entries) - 1);
-    prediction = pht->get_value(idx) > 1;
+}
+
+static inline int8_t tage_ctr_update(int8_t ctr, bool taken) {
+  if(taken) {
+    return (ctr == 3) ? ctr : (ctr + 1);
   }
-  
-  return prediction;
+  return (ctr == -4) ? ctr : (ctr - 1);
 }
 
 void tage::update(uint32_t addr, uint64_t idx, bool prediction, bool taken) {
-  uint32_t n_pht_entries = 1U<<lg_pht_entries;
-			       
-  uint64_t table = idx >> 32;
-  uint32_t entry = (idx & (static_cast<uint64_t>(1) << 32) - 1);
-
+  const int n = static_cast<int>(tables.size());
   bool correct_pred = prediction == taken;
-  
-  assert(entry < n_pht_entries);
-  pred_table[table]++;
-  corr_pred_table[table] += correct_pred;
-  
-  if(table == 0) {
-    pht->update(entry, taken);
-  }
-  else {
-    int t = table - 1;
-    int p = tage_tables[t][entry].pred;
-    p = taken ? p+1 : p-1;
-    p = std::max(0, p);
-    p = std::min(3, p);
-    tage_tables[t][entry].pred = p;
-
-    for(int i = 0; i < tage::n_tables; i++) {
-      if(pred_valid[i] && (i != t) && (pred[i] != prediction)) {
-	int u = tage_tables[t][entry].useful;
-	u = correct_pred ? u + 1 : u - 1;
-	u = (u > 3) ? 3 : u;
-	u = (u < 0) ? 0 : u;
-	tage_tables[t][entry].useful = u;	
-	break;
-      }
-    }
+
+  pred_table[idx]++;
+  corr_pred_table[idx] += correct_pred;
+
+  if(provider >= 0 and provider_weak and (provider_pred != alt_pred)) {
+    use_alt_on_na += (alt_pred == taken) ? 1 : -1;
+    use_alt_on_na = std::min(7, std::max(-8, use_alt_on_na));
   }
 
+  /* a weak provider that was right doesn't need a longer table */
+  bool need_alloc = not(correct_pred) and (provider < (n-1)) and
+    not((provider >= 0) and provider_weak and (provider_pred == taken));
+  if(need_alloc) {
+    allocate(addr, taken);
+  }
 
-  
-  if(!correct_pred) {
-    bool alloc = false;
-    int tagged_table = table - 1;
-    
-    //if(table == 1) printf("longest table mispredicted\n");
-    
-    for(int t = tagged_table+1; t < tage::n_tables; t++) {
-      
-      if(pred_valid[t] && (pred[t] == taken)) {
-	std::cout << "prediction from table " << table << " was incorrect but " << t << " was correct\n";
-	break;
+  if(provider >= 0) {
+    tage_entry &e = tables[provider].entries[tables[provider].idx];
+    e.ctr = tage_ctr_update(e.ctr, taken);
+    if(provider_weak and (e.u == 0)) {
+      if(alt_provider >= 0) {
+	tage_entry &a = tables[alt_provider].entries[tables[alt_provider].idx];
+	a.ctr = tage_ctr_update(a.ctr, taken);
+      }
+      else {
+	pht->update(base_idx, taken);
       }
-      
     }
-    
-    for(int t = table; t < tage::n_tables; t++) {
-      if(tage_tables[t][hashes[t]].useful == 0) {
-	//std::cout << "allocate from table " << t << " for index " << entry << "\n";
-	alloc = true;
-	tage_tables[t][hashes[t]].pred = 1;
-	tage_tables[t][hashes[t]].tag = pc_hash(addr);
-	break;
+    if(provider_pred != alt_pred) {
+      if(provider_pred == taken) {
+	e.u = (e.u == 3) ? 3 : (e.u + 1);
+      }
+      else {
+	e.u = (e.u == 0) ? 0 : (e.u - 1);
       }
     }
+  }
+  else {
+    pht->update(base_idx, taken);
+  }
 
-    
-    if(!alloc) {
-      for(int t = table; t < tage::n_tables; t++) {
-	int u = tage_tables[t][hashes[t]].useful;
-	u = (u == 0) ? 0 : (u-1);
-	tage_tables[t][hashes[t]].useful = u;
+  n_branches++;
+  if((n_branches & ((1UL << lg_u_period) - 1)) == 0) {
+    for(tage_table &tt : tables) {
+      for(tage_entry &e : tt.entries) {
+	e.u >>= 1;
       }
     }
   }
+  if(!correct_pred) {
+    n_mispredicts++;
+    mispredict_map[addr]++;
+  }
+}
 
-  n_branches++;
-  if((n_branches & ((1<<20)-1)) == 0) {
-    for(int t = table; t < tage::n_tables; t++) {
-      tage_tables[t][hashes[t]].useful = 0;
+
+
+
+#ifdef __AVX2__
+/* one byte per bit of h : +1 where it is set, -1 where not */
+static inline __m256i perc_expand(uint32_t h) {
+  const __m256i shuf = _mm256_setr_epi8(0,0,0,0,0,0,0,0,1,1,1,1,1,1,1,1,
+					2,2,2,2,2,2,2,2,3,3,3,3,3,3,3,3);
+  const __m256i bit = _mm256_set1_epi64x(0x8040201008040201L);
+  __m256i v = _mm256_shuffle_epi8(_mm256_set1_epi32(h), shuf);
+  v = _mm256_cmpeq_epi8(_mm256_and_si256(v, bit), bit);
+  return _mm256_sub_epi8(_mm256_and_si256(v, _mm256_set1_epi8(2)),
+			 _mm256_set1_epi8(1));
+}
+
+static inline int32_t perc_dot(const int8_t *w, const uint32_t *h, uint32_t n) {
+  const __m256i ones8 = _mm256_set1_epi8(1), ones16 = _mm256_set1_epi16(1);
+  __m256i acc = _mm256_setzero_si256();
+  for(uint32_t k = 0; k < n; k++) {
+    __m256i wv = _mm256_load_si256(reinterpret_cast<const __m256i*>(w + 32*k));
+    __m256i p = _mm256_sign_epi8(wv, perc_expand(h[k]));
+    acc = _mm256_add_epi32(acc, _mm256_madd_epi16(_mm256_maddubs_epi16(ones8, p), ones16));
+  }
+  __m128i x = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+  x = _mm_add_epi32(x, _mm_shuffle_epi32(x, 0x4e));
+  x = _mm_add_epi32(x, _mm_shuffle_epi32(x, 0xb1));
+  return _mm_cvtsi128_si32(x);
+}
+
+static inline void perc_train(int8_t *w, const uint32_t *h, uint32_t n, bool taken) {
+  const __m256i lo = _mm256_set1_epi8(-127);
+  for(uint32_t k = 0; k < n; k++) {
+    __m256i *p = reinterpret_cast<__m256i*>(w + 32*k);
+    __m256i x = perc_expand(h[k]);
+    __m256i wv = _mm256_load_si256(p);
+    wv = taken ? _mm256_adds_epi8(wv, x) : _mm256_subs_epi8(wv, x);
+    _mm256_store_si256(p, _mm256_max_epi8(wv, lo));
+  }
+}
+#elif defined(__SSSE3__)
+/* the same 16 weights at a time */
+static inline __m128i perc_expand(uint32_t h) {
+  const __m128i shuf = _mm_setr_epi8(0,0,0,0,0,0,0,0,1,1,1,1,1,1,1,1);
+  const __m128i bit = _mm_set1_epi64x(0x8040201008040201L);
+  __m128i v = _mm_shuffle_epi8(_mm_cvtsi32_si128(h), shuf);
+  v = _mm_cmpeq_epi8(_mm_and_si128(v, bit), bit);
+  return _mm_sub_epi8(_mm_and_si128(v, _mm_set1_epi8(2)), _mm_set1_epi8(1));
+}
+
+static inline int32_t perc_dot(const int8_t *w, const uint32_t *h, uint32_t n) {
+  const __m128i ones8 = _mm_set1_epi8(1), ones16 = _mm_set1_epi16(1);
+  __m128i acc = _mm_setzero_si128();
+  for(uint32_t k = 0; k < 2*n; k++) {
+    __m128i wv = _mm_load_si128(reinterpret_cast<const __m128i*>(w + 16*k));
+    __m128i p = _mm_sign_epi8(wv, perc_expand(h[k/2] >> (16*(k%2))));
+    acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_maddubs_epi16(ones8, p), ones16));
+  }
+  acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, 0x4e));
+  acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, 0xb1));
+  return _mm_cvtsi128_si32(acc);
+}
+
+static inline void perc_train(int8_t *w, const uint32_t *h, uint32_t n, bool taken) {
+  const __m128i lo = _mm_set1_epi8(-128);
+  for(uint32_t k = 0; k < 2*n; k++) {
+    __m128i *p = reinterpret_cast<__m128i*>(w + 16*k);
+    __m128i x = perc_expand(h[k/2] >> (16*(k%2)));
+    __m128i wv = _mm_load_si128(p);
+    wv = taken ? _mm_adds_epi8(wv, x) : _mm_subs_epi8(wv, x);
+    /* -128 back up to -127 */
+    _mm_store_si128(p, _mm_sub_epi8(wv, _mm_cmpeq_epi8(wv, lo)));
+  }
+}
+#else
+static inline int32_t perc_dot(const int8_t *w, const uint32_t *h, uint32_t n) {
+  int32_t y = 0;
+  for(uint32_t b = 0; b < 32*n; b++) {
+    y += ((h[b/32] >> (b%32)) & 1) ? w[b] : -w[b];
+  }
+  return y;
+}
+
+static inline void perc_train(int8_t *w, const uint32_t *h, uint32_t n, bool taken) {
+  for(uint32_t b = 0; b < 32*n; b++) {
+    bool agree = (((h[b/32] >> (b%32)) & 1) != 0) == taken;
+    int32_t v = w[b] + (agree ? 1 : -1);
+    w[b] = std::min(127, std::max(-127, v));
+  }
+}
+#endif
+
+static inline int8_t perc_bump(int8_t w, bool up) {
+  if(up) {
+    return (w == 127) ? w : (w + 1);
+  }
+  return (w == -127) ? w : (w - 1);
+}
+
+perceptron::perceptron(uint64_t &icnt, const bpred_config &c) :
+  branch_predictor(icnt),
+  lg_rows(c.perc_lg_rows) {
+  hist_len = std::max(32U, static_cast<uint32_t>((c.bhr_len + 31) & ~31UL));
+  n_chunks = hist_len / 32;
+  /* training threshold from the perceptron paper */
+  theta = static_cast<int32_t>(1.93 * hist_len + 14);
+  size_t sz = (1UL << lg_rows) * hist_len;
+  if(posix_memalign(reinterpret_cast<void**>(&weights), 32, sz) != 0) {
+    std::cerr << "perceptron : can't allocate " << sz << " bytes of weights\n";
+    die();
+  }
+  memset(weights, 0, sz);
+  bias.assign(1UL << lg_rows, 0);
+  hbits.assign(n_chunks, 0);
+}
+
+perceptron::~perceptron() {
+  free(weights);
+}
+
+bool perceptron::predict(uint32_t addr, uint64_t &idx) {
+  idx = (addr >> 2) & ((1U << lg_rows) - 1);
+  for(uint32_t k = 0; k < n_chunks; k += 2) {
+    uint64_t h = bhr->window(32*k);
+    hbits[k] = static_cast<uint32_t>(h);
+    if((k + 1) < n_chunks) {
+      hbits[k+1] = static_cast<uint32_t>(h >> 32);
     }
   }
-  n_mispredicts += !correct_pred;
+  y = bias[idx] + perc_dot(weights + idx*hist_len, hbits.data(), n_chunks);
+  return y >= 0;
+}
 
-  //std::cout << "prediction came from table " << table << "\n";
+void perceptron::update(uint32_t addr, uint64_t idx, bool prediction, bool taken) {
+  bool mispredict = prediction != taken;
+  if(mispredict or (std::abs(y) <= theta)) {
+    bias[idx] = perc_bump(bias[idx], taken);
+    perc_train(weights + idx*hist_len, hbits.data(), n_chunks, taken);
+  }
+  n_branches++;
+  if(mispredict) {
+    n_mispredicts++;
+    mispredict_map[addr]++;
+  }
 }
 
+hashed_perceptron::hashed_perceptron(uint64_t &icnt, const bpred_config &c) :
+  branch_predictor(icnt),
+  lg_rows(c.perc_lg_rows),
+  theta(c.perc_tables) {
+  /* table 0 sees only the pc */
+  const uint32_t n = c.perc_tables;
+  std::vector<uint32_t> lens;
+  if(n > 1) {
+    lens = geometric_lengths(n - 1, 2, std::max<size_t>(2, c.bhr_len));
+  }
+  lens.insert(lens.begin(), 0);
+  tables.resize(n);
+  for(uint32_t t = 0; t < n; t++) {
+    tables[t].hist_len = lens[t];
+    tables[t].fold = 0;
+    tables[t].w.assign(1UL << lg_rows, 0);
+    tables[t].idx = 0;
+  }
+}
 
+hashed_perceptron::~hashed_perceptron() {}
+
+void hashed_perceptron::set_history(sim_history *h) {
+  branch_predictor::set_history(h);
+  for(hp_table &tt : tables) {
+    if(tt.hist_len) {
+      tt.fold = h->add_fold(tt.hist_len, lg_rows);
+    }
+  }
+}
+
+bool hashed_perceptron::predict(uint32_t addr, uint64_t &idx) {
+  const uint32_t pc = addr >> 2;
+  const uint32_t mask = (1U << lg_rows) - 1;
+  idx = 0;
+  y = 0;
+  for(hp_table &tt : tables) {
+    uint64_t h = tt.hist_len ? bhr->fold(tt.fold) : 0;
+    tt.idx = (pc ^ (pc >> lg_rows) ^ h) & mask;
+    y += tt.w[tt.idx];
+  }
+  return y >= 0;
+}
 
+void hashed_perceptron::update(uint32_t addr, uint64_t idx, bool prediction, bool taken) {
+  bool mispredict = prediction != taken;
+  if(mispredict or (std::abs(y) <= theta)) {
+    for(hp_table &tt : tables) {
+      tt.w[tt.idx] = perc_bump(tt.w[tt.idx], taken);
+    }
+    /* nudge theta so mispredicts and low-confidence hits
+     * cause about the same number of updates */
+    if(mispredict) {
+      if(++tc >= 63) {
+	theta++;
+	tc = 0;
+      }
+    }
+    else if(--tc <= -64) {
+      theta = std::max(1, theta - 1);
+      tc = 0;
+    }
+  }
+  n_branches++;
+  if(mispredict) {
+    n_mispredicts++;
+    mispredict_map[addr]++;
+  }
+}
 
 bool gshare::predict(uint32_t addr, uint64_t &idx) {
-  uint64_t fold_bhr = globals::bhr->to_integer();
+  uint64_t fold_bhr = bhr->to_integer();
   old_gbl_hist = fold_bhr;
   
   fold_bhr = (fold_bhr >> 32) ^ (fold_bhr & ((1UL<<32)-1));
@@ -231,7 +508,7 @@ bool gshare::predict(uint32_t addr, uint64_t &idx) {
 
   // if(addr == 0x21fd0) {
     // std::cout << std::hex << addr
-    // 	      << " " << *globals::bhr << ", idx = " << idx
+    // 	      << " " << *bhr << ", idx = " << idx
     // 	      << " gbl hist = " << old_gbl_hist
     // 	      << std::dec
     // 	      << ", clamped idx = "
@@ -270,20 +547,23 @@ void gshare::update(uint32_t addr, uint64_t idx, bool prediction, bool taken) {
   }
 }
 
-gtagged::gtagged(uint64_t &icnt) :
-  branch_predictor(icnt) {}
+gtagged::gtagged(uint64_t &icnt, uint64_t max_entries) :
+  branch_predictor(icnt), pht(max_entries) {}
 gtagged::~gtagged() {}
 
+void gtagged::report(std::ostream &out) const {
+  out << pht << "\n";
+}
+
 bool gtagged::predict(uint32_t addr, uint64_t &idx) {
-  uint64_t hbits = static_cast<uint64_t>(globals::bhr->to_integer());
-  hbits &= ((1UL<<32)-1);
+  uint64_t hbits = bhr->recent(32);
   hbits <<= 32;
   idx = (addr>>2) | hbits;
-  const auto it = pht.find(idx);
-  if(it == pht.cend()) {
+  const uint8_t *e = pht.find(idx);
+  if(e == nullptr) {
     return false;
   }
-  return (it->second > 1);
+  return (*e > 1);
 }
 
 void gtagged::update(uint32_t addr, uint64_t idx, bool prediction, bool taken) {
@@ -302,27 +582,29 @@ void gtagged::update(uint32_t addr, uint64_t idx, bool prediction, bool taken) {
 
 bimodal::bimodal(uint64_t &icnt, uint32_t lg_c_pht_entries, uint32_t lg_pht_entries) :
   branch_predictor(icnt), lg_c_pht_entries(lg_c_pht_entries), lg_pht_entries(lg_pht_entries) {
-  c_pht = new twobit_counter_array(1U<<lg_c_pht_entries);
-  nt_pht = new twobit_counter_array(1U<<lg_pht_entries);
-  t_pht = new twobit_counter_array(1U<<lg_pht_entries);
+  c_pht = new tracked_twobit_counter_array(1U<<lg_c_pht_entries);
+  nt_pht = new tracked_twobit_counter_array(1U<<lg_pht_entries);
+  t_pht = new tracked_twobit_counter_array(1U<<lg_pht_entries);
 }
 
 bimodal::~bimodal() {
-  double x = static_cast<double>(c_pht->count_valid()) / static_cast<double>(c_pht->get_nentries());
-  std::cout << (100.0*x) << "% of choice pht entries valid\n";
-  double y = static_cast<double>(nt_pht->count_valid()) / static_cast<double>(nt_pht->get_nentries());
-  std::cout << (100.0*y) << "% of not taken pht entries valid\n";
-  double z = static_cast<double>(t_pht->count_valid()) / static_cast<double>(t_pht->get_nentries());
-  std::cout << (100.0*z) << "% of taken pht entries valid\n";
-
   delete c_pht;
   delete nt_pht;
   delete t_pht;
 }
 
+void bimodal::report(std::ostream &out) const {
+  double x = static_cast<double>(c_pht->count_valid()) / static_cast<double>(c_pht->get_nentries());
+  out << (100.0*x) << "% of choice pht entries valid\n";
+  double y = static_cast<double>(nt_pht->count_valid()) / static_cast<double>(nt_pht->get_nentries());
+  out << (100.0*y) << "% of not taken pht entries valid\n";
+  double z = static_cast<double>(t_pht->count_valid()) / static_cast<double>(t_pht->get_nentries());
+  out << (100.0*z) << "% of taken pht entries valid\n";
+}
+
 bool bimodal::predict(uint32_t addr, uint64_t &idx) {
   uint32_t c_idx = (addr>>2) & ((1U<<lg_c_pht_entries)-1);
-  idx = ((addr>>2) ^ globals::bhr->to_integer()) & ((1U<<lg_pht_entries)-1);
+  idx = ((addr>>2) ^ bhr->to_integer()) & ((1U<<lg_pht_entries)-1);
   if(c_pht->get_value(c_idx) < 2) {
     return nt_pht->get_value(idx)>1;
   }
@@ -348,6 +630,181 @@ void bimodal::update(uint32_t addr, uint64_t idx, bool prediction, bool taken) {
 }
 
 
+loop_table::loop_table(uint32_t lg_entries) :
+  lg_sets(lg_entries > 2 ? lg_entries - 2 : 0) {
+  entries.assign(n_ways << lg_sets, loop_entry());
+}
+
+uint64_t loop_table::bytes() const {
+  /* tag, two iteration counts, 2-bit conf, 8-bit age, dir */
+  uint64_t bits = tag_bits + 14 + 14 + 2 + 8 + 1;
+  return (entries.size() * bits + 7) / 8;
+}
+
+bool loop_table::lookup(uint32_t addr, bool &p) {
+  set = (addr >> 2) & ((1U << lg_sets) - 1);
+  tag = (addr >> (2 + lg_sets)) & ((1U << tag_bits) - 1);
+  hit = nullptr;
+  confident = false;
+  for(uint32_t w = 0; w < n_ways; w++) {
+    loop_entry &e = entries[set * n_ways + w];
+    if(e.valid and (e.tag == tag)) {
+      hit = &e;
+      break;
+    }
+  }
+  if(hit == nullptr) {
+    return false;
+  }
+  /* the iteration after past_iter-1 in the loop direction exits */
+  pred = ((hit->cur_iter + 1) == hit->past_iter) ? not(hit->dir) : hit->dir;
+  confident = (hit->conf == conf_max);
+  n_confident += confident;
+  p = pred;
+  return confident;
+}
+
+void loop_table::update(bool taken, bool allocate) {
+  if(hit) {
+    loop_entry &e = *hit;
+    if(confident) {
+      if(pred != taken) {
+	/* the trip count changed, relearn it */
+	e.valid = false;
+	return;
+      }
+      n_correct++;
+      e.age += (e.age != 0xff);
+    }
+    if(++e.cur_iter > max_iter) {
+      /* not a loop we can count */
+      e.valid = false;
+      return;
+    }
+    if(taken != e.dir) {
+      if(e.cur_iter == e.past_iter) {
+	e.conf += (e.conf != conf_max);
+      }
+      else if(e.past_iter == 0) {
+	/* first exit seen since allocation */
+	e.past_iter = e.cur_iter;
+      }
+      else {
+	e.valid = false;
+      }
+      e.cur_iter = 0;
+    }
+    return;
+  }
+  if(not(allocate)) {
+    return;
+  }
+  loop_entry *v = nullptr;
+  for(uint32_t w = 0; w < n_ways and v == nullptr; w++) {
+    loop_entry &e = entries[set * n_ways + w];
+    if(not(e.valid) or (e.age == 0)) {
+      v = &e;
+    }
+  }
+  if(v == nullptr) {
+    for(uint32_t w = 0; w < n_ways; w++) {
+      entries[set * n_ways + w].age--;
+    }
+    return;
+  }
+  /* a mispredict in a loop is usually its exit, so the loop
+   * runs the other way */
+  v->valid = true;
+  v->tag = tag;
+  v->dir = not(taken);
+  v->past_iter = 0;
+  v->cur_iter = 0;
+  v->conf = 0;
+  v->age = 0xff;
+  n_allocs++;
+}
+
+static void print_loop_stats(std::ostream &out, const loop_table &l) {
+  out << "loop table : " << l.bytes() << " bytes, "
+	    << l.n_allocs << " allocations, "
+	    << l.n_confident << " confident predictions, "
+	    << l.n_correct << " correct\n";
+}
+
+loop_predictor::loop_predictor(uint64_t &icnt, const bpred_config &c) :
+  branch_predictor(icnt), loops(c.loop_lg_sz), lg_pht_entries(c.lg_pht_sz) {
+  pht = new twobit_counter_array(1U<<lg_pht_entries);
+}
+
+loop_predictor::~loop_predictor() {
+  delete pht;
+}
+
+void loop_predictor::report(std::ostream &out) const {
+  print_loop_stats(out, loops);
+}
+
+bool loop_predictor::predict(uint32_t addr, uint64_t &idx) {
+  idx = (addr>>2) & ((1U<<lg_pht_entries)-1);
+  base_pred = pht->get_value(idx) > 1;
+  bool p = false;
+  return loops.lookup(addr, p) ? p : base_pred;
+}
+
+void loop_predictor::update(uint32_t addr, uint64_t idx, bool prediction, bool taken) {
+  loops.update(taken, base_pred != taken);
+  pht->update(idx, taken);
+  n_branches++;
+  if(prediction != taken) {
+    n_mispredicts++;
+    mispredict_map[addr]++;
+  }
+}
+
+loop_override::loop_override(uint64_t &icnt, const bpred_config &c, branch_predictor *inner) :
+  branch_predictor(icnt), name(std::string("loop+") + inner->getTypeString()),
+  inner(inner), loops(c.loop_lg_sz) {}
+
+loop_override::~loop_override() {
+  delete inner;
+}
+
+void loop_override::report(std::ostream &out) const {
+  print_loop_stats(out, loops);
+  inner->report(out);
+}
+
+void loop_override::set_history(sim_history *h) {
+  branch_predictor::set_history(h);
+  inner->set_history(h);
+}
+
+bool loop_override::predict(uint32_t addr, uint64_t &idx) {
+  inner_pred = inner->predict(addr, inner_idx);
+  loop_valid = loops.lookup(addr, loop_pred);
+  idx = inner_idx;
+  return (loop_valid and (with_loop >= 0)) ? loop_pred : inner_pred;
+}
+
+void loop_override::update(uint32_t addr, uint64_t idx, bool prediction, bool taken) {
+  if(loop_valid and (loop_pred != inner_pred)) {
+    if(loop_pred == taken) {
+      with_loop += (with_loop != 63);
+    }
+    else {
+      with_loop -= (with_loop != -64);
+    }
+  }
+  loops.update(taken, inner_pred != taken);
+  inner->update(addr, inner_idx, inner_pred, taken);
+  n_branches++;
+  if(prediction != taken) {
+    n_mispredicts++;
+    mispredict_map[addr]++;
+  }
+}
+
+
 std::ostream &operator<<(std::ostream &out, const branch_predictor& bp) {
   uint64_t n_br=0,n_mis=0, icnt = 0;
   bp.get_stats(n_br,n_mis,icnt);
@@ -368,8 +825,301 @@ branch_predictor::bpred_impl branch_predictor::lookup_impl(const std::string& im
   return it->second;
 }
 
+branch_predictor *branch_predictor::make(const bpred_config &c, uint64_t &icnt) {
+  branch_predictor *bp = nullptr;
+  bpred_impl impl = lookup_impl(c.impl);
+  switch(impl)
+    {
+    case bpred_impl::bimodal:
+      bp = new bimodal(icnt,c.lg_c_pht_sz,c.lg_pht_sz);
+      break;
+    case bpred_impl::gtagged:
+      bp = new gtagged(icnt,c.gtagged_cap);
+      break;
+    case bpred_impl::uberhistory:
+      bp = new uberhistory(icnt,c.lg_pht_sz);
+      break;
+    case bpred_impl::tage:
+      bp = new tage(icnt,c);
+      break;
+    case bpred_impl::perceptron:
+      bp = new perceptron(icnt,c);
+      break;
+    case bpred_impl::hperceptron:
+      bp = new hashed_perceptron(icnt,c);
+      break;
+    case bpred_impl::loop:
+      return new loop_predictor(icnt,c);
+    default:
+    case bpred_impl::gshare:
+      bp = new gshare(icnt,c.lg_pht_sz,c.pc_shift);
+      break;
+    }
+  if(c.loop) {
+    bp = new loop_override(icnt,c,bp);
+  }
+  return bp;
+}
+
 #define PAIR(X) {#X, branch_predictor::bpred_impl::X},
 const std::map<std::string, branch_predictor::bpred_impl> branch_predictor::bpred_impl_map = {
   BPRED_IMPL_LIST(PAIR)
 };
 #undef PAIR
+
+/* name sets every table, nameN only table N */
+static bool set_per_table(const std::string &key, const std::string &name,
+			  const std::string &v, uint32_t *arr, bool &ok) {
+  if(key.compare(0, name.size(), name) != 0) {
+    return false;
+  }
+  uint32_t val = 0;
+  if(not(parseNumber(v, val))) {
+    ok = false;
+    return true;
+  }
+  if(key.size() == name.size()) {
+    for(uint32_t t = 0; t < bpred_config::max_tage_tables; t++) {
+      arr[t] = val;
+    }
+    return true;
+  }
+  char *end = nullptr;
+  uint64_t t = strtoull(key.c_str() + name.size(), &end, 10);
+  ok = (*end == '\0') and (t < bpred_config::max_tage_tables);
+  if(ok) {
+    arr[t] = val;
+  }
+  return true;
+}
+
+bool bpred_config::set(const std::string &key, const std::string &v) {
+  if(key == "file") {
+    return load(v);
+  }
+  bool ok = true;
+  if(key == "lg_pht_sz") {
+    ok = parseNumber(v, lg_pht_sz);
+  }
+  else if(key == "lg_c_pht_sz") {
+    ok = parseNumber(v, lg_c_pht_sz);
+  }
+  else if(key == "pc_shift") {
+    ok = parseNumber(v, pc_shift);
+  }
+  else if(key == "bhr_len") {
+    ok = parseNumber(v, bhr_len);
+  }
+  else if(key == "tage_tables") {
+    ok = parseNumber(v, tage_tables);
+  }
+  else if(key == "tage_min_hist") {
+    ok = parseNumber(v, tage_min_hist);
+  }
+  else if(key == "tage_max_hist") {
+    ok = parseNumber(v, tage_max_hist);
+  }
+  else if(key == "tage_lg_u_period") {
+    ok = parseNumber(v, tage_lg_u_period);
+  }
+  else if(key == "tage_alloc") {
+    ok = parseNumber(v, tage_alloc);
+  }
+  else if(key == "perc_lg_rows") {
+    ok = parseNumber(v, perc_lg_rows);
+  }
+  else if(key == "perc_tables") {
+    ok = parseNumber(v, perc_tables);
+  }
+  else if(key == "gtagged_cap") {
+    ok = parseNumber(v, gtagged_cap);
+  }
+  else if(key == "loop") {
+    ok = parseNumber(v, loop);
+  }
+  else if(key == "loop_lg_sz") {
+    ok = parseNumber(v, loop_lg_sz);
+  }
+  else if(set_per_table(key, "tage_lg_sz", v, tage_lg_sz, ok)) {
+  }
+  else if(set_per_table(key, "tage_tag_bits", v, tage_tag_bits, ok)) {
+  }
+  else {
+    return false;
+  }
+  return ok;
+}
+
+bool bpred_config::valid() const {
+  if(lg_pht_sz == 0 or lg_pht_sz > 24 or
+     lg_c_pht_sz == 0 or lg_c_pht_sz > 24 or
+     pc_shift > 31 or bhr_len == 0 or bhr_len > 1024 or
+     tage_tables == 0 or tage_tables > max_tage_tables or
+     tage_min_hist == 0 or tage_min_hist > tage_max_hist or
+     tage_alloc == 0 or tage_lg_u_period == 0 or tage_lg_u_period > 40 or
+     perc_lg_rows == 0 or perc_lg_rows > 24 or
+     perc_tables == 0 or perc_tables > 32 or
+     loop_lg_sz < 2 or loop_lg_sz > 20) {
+    return false;
+  }
+  for(uint32_t t = 0; t < tage_tables; t++) {
+    if(tage_lg_sz[t] == 0 or tage_lg_sz[t] > 24 or
+       tage_tag_bits[t] < 2 or tage_tag_bits[t] > 16) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool bpred_config::parse(const std::string &spec) {
+  spec_pairs kvs;
+  if(not(splitSpec(spec, &impl, kvs)) or
+     (branch_predictor::lookup_impl(impl) == branch_predictor::bpred_impl::unknown)) {
+    return false;
+  }
+  for(const auto &kv : kvs) {
+    if(not(set(kv.first, kv.second))) {
+      return false;
+    }
+  }
+  return valid();
+}
+
+/* one key=value per line, # starts a comment */
+bool bpred_config::load(const std::string &fname) {
+  std::ifstream in(fname);
+  if(not(in.good())) {
+    return false;
+  }
+  std::string line;
+  while(std::getline(in, line)) {
+    line = line.substr(0, line.find('#'));
+    line.erase(std::remove_if(line.begin(), line.end(), ::isspace), line.end());
+    if(line.empty()) {
+      continue;
+    }
+    size_t eq = line.find('=');
+    if(eq == std::string::npos) {
+      return false;
+    }
+    std::string key = line.substr(0, eq);
+    if((key == "impl") and
+       (branch_predictor::lookup_impl(line.substr(eq + 1)) != branch_predictor::bpred_impl::unknown)) {
+      impl = line.substr(eq + 1);
+    }
+    else if(not(set(key, line.substr(eq + 1)))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void str_per_table(std::stringstream &ss, const std::string &name,
+			  const uint32_t *arr, uint32_t n) {
+  bool same = true;
+  for(uint32_t t = 1; t < n; t++) {
+    same &= (arr[t] == arr[0]);
+  }
+  if(same) {
+    ss << "," << name << "=" << arr[0];
+    return;
+  }
+  for(uint32_t t = 0; t < n; t++) {
+    ss << "," << name << t << "=" << arr[t];
+  }
+}
+
+std::string bpred_config::str() const {
+  std::stringstream ss;
+  ss << impl
+     << ",lg_pht_sz=" << lg_pht_sz
+     << ",lg_c_pht_sz=" << lg_c_pht_sz
+     << ",pc_shift=" << pc_shift
+     << ",bhr_len=" << bhr_len;
+  if(impl == "tage") {
+    ss << ",tage_tables=" << tage_tables
+       << ",tage_min_hist=" << tage_min_hist
+       << ",tage_max_hist=" << tage_max_hist;
+    str_per_table(ss, "tage_lg_sz", tage_lg_sz, tage_tables);
+    str_per_table(ss, "tage_tag_bits", tage_tag_bits, tage_tables);
+    ss << ",tage_lg_u_period=" << tage_lg_u_period
+       << ",tage_alloc=" << tage_alloc;
+  }
+  else if(impl == "perceptron") {
+    ss << ",perc_lg_rows=" << perc_lg_rows;
+  }
+  else if(impl == "gtagged") {
+    ss << ",gtagged_cap=" << gtagged_cap;
+  }
+  else if(impl == "hperceptron") {
+    ss << ",perc_lg_rows=" << perc_lg_rows
+       << ",perc_tables=" << perc_tables;
+  }
+  else if(impl == "loop") {
+    ss << ",loop_lg_sz=" << loop_lg_sz;
+  }
+  if(loop and (impl != "loop")) {
+    ss << ",loop=1,loop_lg_sz=" << loop_lg_sz;
+  }
+  return ss.str();
+}
+
+predictor_group::~predictor_group() {
+  for(size_t i = 0; i < preds.size(); i++) {
+    delete preds[i];
+    delete hists[i];
+  }
+  delete ipred;
+}
+
+indirect_predictor *predictor_group::set_indirect(const ipred_config &c, uint64_t &icnt) {
+  delete ipred;
+  ipred = indirect_predictor::make(c, icnt);
+  return ipred;
+}
+
+branch_predictor *predictor_group::add(const bpred_config &c, uint64_t &icnt) {
+  branch_predictor *bp = branch_predictor::make(c, icnt);
+  bpred_config cc = c;
+  if(bp->needed_history_length()) {
+    cc.bhr_len = bp->needed_history_length();
+  }
+  sim_history *h = new sim_history(cc.bhr_len);
+  bp->set_history(h);
+  preds.push_back(bp);
+  hists.push_back(h);
+  configs.push_back(cc);
+  return bp;
+}
+
+void predictor_group::branch(uint32_t pc, bool taken) {
+  for(size_t i = 0, n = preds.size(); i < n; i++) {
+    uint64_t idx;
+    bool bp = preds[i]->predict(pc, idx);
+    hists[i]->push(taken);
+    preds[i]->update(pc, idx, bp, taken);
+  }
+  if(ipred) {
+    ipred->branch(taken);
+  }
+}
+
+void predictor_group::jump() {
+  for(sim_history *h : hists) {
+    h->push(true);
+  }
+}
+
+void predictor_group::report(std::ostream &out) const {
+  for(const branch_predictor *p : preds) {
+    p->report(out);
+  }
+}
+
+std::ostream &operator<<(std::ostream &out, const predictor_group &g) {
+  for(size_t i = 0; i < g.size(); i++) {
+    out << "[" << i << "] " << g.config(i).str() << "\n";
+    out << *g[i] << "\n";
+  }
+  return out;
+}
@@ -1,12 +1,16 @@
-#ifndef __bpred_hh__x
+#ifndef __bpred_hh__
 #define __bpred_hh__
 
 #include <cstdint>
 #include <ostream>
 #include <map>
 #include <string>
+#include <vector>
 #include "counter2b.hh"
-#include "sim_bitvec.hh"
+#include "helper.hh"
+#include "sim_history.hh"
+#include "flatHash.hh"
+#include "indirectPredictor.hh"
 
 #define BPRED_IMPL_LIST(BA) \
   BA(unknown)		    \
@@ -14,7 +18,54 @@
   BA(bimodal)		    \
   BA(gtagged)		    \
   BA(uberhistory)	    \
-  BA(tage)
+  BA(tage)		    \
+  BA(perceptron)	    \
+  BA(hperceptron)	    \
+  BA(loop)
+
+/* one predictor configuration, written on the command line as
+ * impl[,key=value...], e.g. "gshare,lg_pht_sz=14,bhr_len=24".
+ * file=path reads more key=value lines from a file */
+struct bpred_config {
+  static const uint32_t max_tage_tables = 16;
+  std::string impl = "gshare";
+  uint32_t lg_pht_sz = 16;
+  uint32_t lg_c_pht_sz = 16;
+  uint32_t pc_shift = 3;
+  size_t bhr_len = 32;
+  /* tage only. tage_lg_sz and tage_tag_bits set every table,
+   * tage_lg_szN and tage_tag_bitsN only table N */
+  uint32_t tage_tables = 7;
+  uint32_t tage_min_hist = 5;
+  uint32_t tage_max_hist = 640;
+  uint32_t tage_lg_sz[max_tage_tables] = {10,10,10,10,10,10,10,10,
+					  10,10,10,10,10,10,10,10};
+  uint32_t tage_tag_bits[max_tage_tables] = {8,9,10,11,12,13,14,15,
+					     16,16,16,16,16,16,16,16};
+  /* lg2 of branches between halvings of the useful counters */
+  uint32_t tage_lg_u_period = 18;
+  /* most entries allocated on one mispredict */
+  uint32_t tage_alloc = 1;
+  /* perceptron and hperceptron. both use bhr_len as their
+   * (longest) history */
+  uint32_t perc_lg_rows = 10;
+  uint32_t perc_tables = 8;
+  /* gtagged table entries, 0 for unbounded */
+  uint64_t gtagged_cap = 0;
+  /* loop=1 puts a loop predictor in front of impl. loop_lg_sz is
+   * lg2 of its entries, for the standalone loop predictor too */
+  uint32_t loop = 0;
+  uint32_t loop_lg_sz = 6;
+  /* overrides the fields named in spec, false if it is malformed */
+  bool parse(const std::string &spec);
+  bool load(const std::string &fname);
+  bool set(const std::string &key, const std::string &val);
+  bool valid() const;
+  std::string str() const;
+};
+
+/* n history lengths from lo to hi in a geometric series */
+std::vector<uint32_t> geometric_lengths(uint32_t n, uint32_t lo, uint32_t hi);
 
 class branch_predictor {
 public:
@@ -26,6 +77,8 @@ public:
   static const std::map<std::string, bpred_impl> bpred_impl_map;
 protected:
   uint64_t &icnt;
+  /* global history, owned by whoever feeds the predictor */
+  sim_history *bhr;
   uint64_t n_branches;
   uint64_t n_mispredicts;
   uint64_t old_gbl_hist;
@@ -37,8 +90,17 @@ public:
   virtual bool predict(uint32_t, uint64_t &)  = 0;
   virtual void update(uint32_t, uint64_t, bool, bool) = 0;
   virtual int needed_history_length() const { return 0; }
+  /* predictors that index with folded history register their
+   * folds here */
+  virtual void set_history(sim_history *h) {
+    bhr = h;
+  }
   virtual const char* getTypeString() const =  0;
+  /* per-table stats beyond what operator<< prints. single runs
+   * report them, sweep jobs just drop the predictor */
+  virtual void report(std::ostream &out) const {}
   static bpred_impl lookup_impl(const std::string& impl_name);
+  static branch_predictor *make(const bpred_config &c, uint64_t &icnt);
   const std::map<uint32_t, uint64_t> &getMap() const {
     return mispredict_map;
   }
@@ -64,65 +126,129 @@ public:
 };
 
 
+/* tage (Seznec and Michaud) : a bimodal base table plus tagged
+ * tables indexed with geometrically longer histories. the
+ * longest hit provides the prediction, unless its counter is
+ * weak and use_alt_on_na says the next longest does better */
 class tage : public branch_predictor {
-  #define TAG_LEN 12
-  template<typename T, typename std::enable_if<std::is_integral<T>::value, T>::type* = nullptr>
-  struct te {
-    T pred : 2;
-    T useful : 2;
-    T tag : TAG_LEN;
-    void clear() {
-      pred = 0;
-      useful = 0;
-      tag = 0;
-    }
-  };
-  typedef te<uint64_t> tage_entry;
-  static uint32_t pc_hash(uint32_t pc) {
-    const uint32_t mask = ((1U<<TAG_LEN)-1);
-    return (pc >> 2) & mask;
-  }
-  #undef TAG_LEN
 protected:
   constexpr static const char* typeString = "tage";
-
-  static const int n_tables = 3;  
-  const int table_lengths[n_tables] =  {256,32};  
-  
-  tage_entry *tage_tables[n_tables] = {nullptr};
-  uint64_t hashes[n_tables] = {0};
-  bool pred[n_tables] = {false};
-  bool pred_valid[n_tables] = {false};
-  
-  //statistics
-  uint64_t pred_table[n_tables+1] = {0};
-  uint64_t corr_pred_table[n_tables+1] = {0};
-  
+  struct tage_entry {
+    /* 3-bit signed, taken when >= 0 */
+    int8_t ctr;
+    /* 2-bit useful */
+    uint8_t u;
+    uint16_t tag;
+  };
+  struct tage_table {
+    uint32_t hist_len, lg_sz, tag_bits;
+    size_t fold_idx, fold_tag0, fold_tag1;
+    std::vector<tage_entry> entries;
+    /* index and tag of the branch being predicted */
+    uint32_t idx;
+    uint16_t tag;
+  };
+  std::vector<tage_table> tables;
   uint32_t lg_pht_entries = 0;
   twobit_counter_array *pht = nullptr;
+  uint32_t lg_u_period = 0, alloc_max = 0;
+  /* 4-bit signed */
+  int32_t use_alt_on_na = 0;
+  xorshift32 rng;
+
+  /* what the last predict saw */
+  int provider = -1, alt_provider = -1;
+  bool provider_pred = false, alt_pred = false, provider_weak = false;
+  uint32_t base_idx = 0;
 
-  
+  //statistics
+  std::vector<uint64_t> pred_table;
+  std::vector<uint64_t> corr_pred_table;
+
+  void allocate(uint32_t addr, bool taken);
 public:
-  tage(uint64_t & icnt, uint32_t lg_pht_entries);
+  tage(uint64_t & icnt, const bpred_config &c);
   ~tage();
+  void report(std::ostream &out) const override;
+  const char* getTypeString() const override {
+    return typeString;
+  }
+  bool predict(uint32_t, uint64_t &) override;
+  void update(uint32_t addr, uint64_t idx, bool prediction, bool taken) override;
+  int needed_history_length() const override {
+    return tables.back().hist_len;
+  }
+  void set_history(sim_history *h) override;
+};
+
+/* perceptron (Jimenez and Lin) : a row of int8 weights per
+ * branch, one per history bit plus a bias. the history is used
+ * in 32-bit chunks so the dot product and training run 32
+ * weights at a time with avx2 (16 with ssse3) */
+class perceptron : public branch_predictor {
+protected:
+  constexpr static const char* typeString = "perceptron";
+  uint32_t lg_rows = 0;
+  /* bhr_len rounded up to a whole chunk */
+  uint32_t hist_len = 0, n_chunks = 0;
+  int32_t theta = 0;
+  int8_t *weights = nullptr;
+  std::vector<int8_t> bias;
+  /* history and output seen by the last predict */
+  std::vector<uint32_t> hbits;
+  int32_t y = 0;
+public:
+  perceptron(uint64_t & icnt, const bpred_config &c);
+  ~perceptron();
+  const char* getTypeString() const override {
+    return typeString;
+  }
+  bool predict(uint32_t, uint64_t &) override;
+  void update(uint32_t addr, uint64_t idx, bool prediction, bool taken) override;
+  int needed_history_length() const override {
+    return hist_len;
+  }
+};
+
+/* hashed perceptron over geometric history lengths (Seznec's
+ * O-GEHL) : perc_tables tables of int8 weights, each indexed
+ * with the pc and a fold of one history length. the weights
+ * picked are summed and trained against an adaptive threshold */
+class hashed_perceptron : public branch_predictor {
+protected:
+  constexpr static const char* typeString = "hperceptron";
+  struct hp_table {
+    uint32_t hist_len;
+    size_t fold;
+    std::vector<int8_t> w;
+    uint32_t idx;
+  };
+  std::vector<hp_table> tables;
+  uint32_t lg_rows = 0;
+  int32_t theta = 0, tc = 0, y = 0;
+public:
+  hashed_perceptron(uint64_t & icnt, const bpred_config &c);
+  ~hashed_perceptron();
   const char* getTypeString() const override {
     return typeString;
   }
   bool predict(uint32_t, uint64_t &) override;
   void update(uint32_t addr, uint64_t idx, bool prediction, bool taken) override;
   int needed_history_length() const override {
-    return table_lengths[0];
+    return tables.back().hist_len;
   }
+  void set_history(sim_history *h) override;
 };
 
 
 class gtagged : public branch_predictor {
 protected:
   constexpr static const char* typeString = "gtagged";  
-  std::map<uint64_t, uint8_t> pht;
+  flat_hash<uint8_t> pht;
 public:
-  gtagged(uint64_t &);
+  gtagged(uint64_t &, uint64_t max_entries = 0);
   ~gtagged();
+  void report(std::ostream &out) const override;
   const char* getTypeString() const override {
     return typeString;
   }  
@@ -136,12 +262,13 @@ protected:
   constexpr static const char* typeString = "bimodal";
   uint32_t lg_c_pht_entries = 0;
   uint32_t lg_pht_entries = 0 ;
-  twobit_counter_array *c_pht = nullptr;
-  twobit_counter_array *t_pht = nullptr;
-  twobit_counter_array *nt_pht = nullptr;
+  tracked_twobit_counter_array *c_pht = nullptr;
+  tracked_twobit_counter_array *t_pht = nullptr;
+  tracked_twobit_counter_array *nt_pht = nullptr;
 public:
   bimodal(uint64_t &,uint32_t,uint32_t);
   ~bimodal();
+  void report(std::ostream &out) const override;
   const char *getTypeString() const override {
     return typeString;    
   }
@@ -152,11 +279,73 @@ public:
 class uberhistory : public branch_predictor {
 protected:
   constexpr static const char* typeString = "uberhistory";
-  std::map<std::string, uint8_t> pht;
-  std::string sidx;
+  /* key is pc>>2 in the low word then every history bit */
+  std::vector<uint64_t> key;
+  wide_hash<uint8_t> *pht = nullptr;
+  /* counter found by the last predict */
+  uint8_t *ctr = nullptr;
 public:
   uberhistory(uint64_t &, uint32_t);
   ~uberhistory();
+  void report(std::ostream &out) const override;
+  const char* getTypeString() const override {
+    return typeString;
+  }
+  bool predict(uint32_t, uint64_t &) override;
+  void update(uint32_t addr, uint64_t idx, bool prediction, bool taken) override;
+  /* sizes the key to the history */
+  void set_history(sim_history *h) override;
+};
+
+/* loop table (Seznec's L-TAGE) : 4-way sets of entries that
+ * learn a branch's trip count, i.e. how many times it goes one
+ * way before going the other once. after the same trip count is
+ * seen conf_max times in a row the entry predicts the exit */
+class loop_table {
+private:
+  static const uint32_t n_ways = 4;
+  static const uint32_t tag_bits = 14;
+  static const uint16_t max_iter = (1U << 14) - 1;
+  static const uint8_t conf_max = 3;
+  struct loop_entry {
+    uint16_t tag;
+    uint16_t past_iter;
+    uint16_t cur_iter;
+    uint8_t conf;
+    uint8_t age;
+    bool dir;
+    bool valid;
+  };
+  std::vector<loop_entry> entries;
+  uint32_t lg_sets = 0;
+  /* what the last lookup saw */
+  loop_entry *hit = nullptr;
+  uint32_t set = 0;
+  uint16_t tag = 0;
+  bool confident = false, pred = false;
+public:
+  uint64_t n_allocs = 0, n_confident = 0, n_correct = 0;
+  loop_table(uint32_t lg_entries);
+  /* true when a confident entry predicts pred */
+  bool lookup(uint32_t addr, bool &pred);
+  /* call after lookup of the same branch. allocate asks for an
+   * entry when there is none, typically on a mispredict */
+  void update(bool taken, bool allocate);
+  uint64_t bytes() const;
+};
+
+/* loop table alone, falling back to a pc-indexed 2-bit table */
+class loop_predictor : public branch_predictor {
+protected:
+  constexpr static const char* typeString = "loop";
+  loop_table loops;
+  uint32_t lg_pht_entries = 0;
+  twobit_counter_array *pht = nullptr;
+  bool base_pred = false;
+public:
+  loop_predictor(uint64_t &icnt, const bpred_config &c);
+  ~loop_predictor();
+  void report(std::ostream &out) const override;
   const char* getTypeString() const override {
     return typeString;
   }
@@ -164,8 +353,73 @@ public:
   void update(uint32_t addr, uint64_t idx, bool prediction, bool taken) override;
 };
 
+/* a loop table in front of any predictor. a confident loop entry
+ * overrides it while with_loop says that has paid off */
+class loop_override : public branch_predictor {
+protected:
+  std::string name;
+  branch_predictor *inner = nullptr;
+  loop_table loops;
+  /* 7-bit signed */
+  int32_t with_loop = 0;
+  /* what the last predict saw */
+  uint64_t inner_idx = 0;
+  bool inner_pred = false, loop_valid = false, loop_pred = false;
+public:
+  loop_override(uint64_t &icnt, const bpred_config &c, branch_predictor *inner);
+  ~loop_override();
+  void report(std::ostream &out) const override;
+  const char* getTypeString() const override {
+    return name.c_str();
+  }
+  bool predict(uint32_t, uint64_t &) override;
+  void update(uint32_t addr, uint64_t idx, bool prediction, bool taken) override;
+  int needed_history_length() const override {
+    return inner->needed_history_length();
+  }
+  void set_history(sim_history *h) override;
+};
+
 std::ostream &operator<<(std::ostream &, const branch_predictor&);
 
+/* predictors that each keep their own history register but see
+ * the same stream of branches and jumps */
+class predictor_group {
+private:
+  std::vector<branch_predictor*> preds;
+  std::vector<sim_history*> hists;
+  std::vector<bpred_config> configs;
+  indirect_predictor *ipred = nullptr;
+public:
+  ~predictor_group();
+  branch_predictor *add(const bpred_config &c, uint64_t &icnt);
+  size_t size() const {
+    return preds.size();
+  }
+  branch_predictor *operator[](size_t i) const {
+    return preds[i];
+  }
+  const bpred_config &config(size_t i) const {
+    return configs[i];
+  }
+  /* the group also owns at most one indirect predictor */
+  indirect_predictor *set_indirect(const ipred_config &c, uint64_t &icnt);
+  indirect_predictor *indirect() const {
+    return ipred;
+  }
+  void branch(uint32_t pc, bool taken);
+  void report(std::ostream &out) const;
+  /* jumps shift a taken bit into every history */
+  void jump();
+  /* jr other than jr $31 and jalr, true when the target was
+   * predicted or there is no indirect predictor */
+  bool indirect_jump(uint32_t pc, uint32_t target) {
+    return ipred ? ipred->jump(pc, target) : true;
+  }
+};
+
+std::ostream &operator<<(std::ostream &, const predictor_group&);
+
 #ifndef KEEP_BPRED_IMPL_IMPL
 #undef BPRED_IMPL_IMPL
 #endif
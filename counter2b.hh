@@ -3,85 +3,73 @@
 
 #include <cstdint>
 #include <cassert>
-#include "sim_bitvec.hh"
+#include <type_traits>
+#include <vector>
 
-class twobit_counter_array {
+/* n_entries unsigned Bits-wide saturating counters packed into
+ * 64-bit words, 64/Bits to a word so none straddle two. get and
+ * update are shift/mask arithmetic with no branches. with
+ * TrackValid each update also marks its entry, for count_valid */
+template <uint32_t Bits, bool TrackValid = false>
+class saturating_counter_array {
+  static_assert(Bits >= 1 and Bits <= 8, "counters are 1 to 8 bits");
 private:
-  struct entry {
-    uint8_t x : 2;
-    uint8_t y : 2;
-    uint8_t z : 2;
-    uint8_t w : 2;
-  };
-  uint64_t n_entries, n_elems;
-  entry *arr = nullptr;
-  sim_bitvec valid;
+  static const uint64_t per_word = 64 / Bits;
+  static const uint64_t max_value = (1UL << Bits) - 1;
+  uint64_t n_entries;
+  std::vector<uint64_t> arr;
+  std::vector<uint64_t> valid;
 public:
-  twobit_counter_array(uint64_t n_entries) :
+  saturating_counter_array(uint64_t n_entries) :
     n_entries(n_entries) {
-    n_elems = (n_entries + 3) / 4;
-    arr = new entry[n_elems];
-    for(uint64_t i = 0; i < n_elems; i++) {
-      /* initialize as weakly not-taken */
-      arr[i].x = arr[i].y = arr[i].z = arr[i].w = 1;
+    /* initialize as weakly not-taken */
+    uint64_t init = 0;
+    for(uint64_t i = 0; i < per_word; i++) {
+      init |= ((max_value >> 1) << (i * Bits));
+    }
+    arr.assign((n_entries + per_word - 1) / per_word, init);
+    if(TrackValid) {
+      valid.assign((n_entries + 63) / 64, 0);
     }
-    valid.clear_and_resize(n_entries);
-  }
-  ~twobit_counter_array() {
-    delete [] arr;
   }
   uint8_t get_value(uint64_t idx) const {
     assert(idx < n_entries);
-    uint8_t v = 0;
-    switch(idx&0x3)
-      {
-      case 0:
-	v = arr[idx/4].x;
-	break;
-      case 1:
-	v = arr[idx/4].y;
-	break;
-      case 2:
-	v = arr[idx/4].z;
-	break;
-      case 3:
-	v = arr[idx/4].w;
-	break;
-      }
-    return v;
+    uint64_t sh = (idx % per_word) * Bits;
+    return (arr[idx / per_word] >> sh) & max_value;
   }
   void update(uint64_t idx, bool incr) {
     assert(idx < n_entries);
-    valid.set_bit(idx);
-    uint8_t v = get_value(idx);
-    if(incr) {
-      v = (v > 2) ? v : (v+1);
-    }
-    else {
-      v = (v==0) ? v : (v-1);
+    if(TrackValid) {
+      valid[idx / 64] |= 1UL << (idx % 64);
     }
-    switch(idx&0x3)
-      {
-      case 0:
-        arr[idx/4].x = v;
-	break;
-      case 1:
-	arr[idx/4].y = v;
-	break;
-      case 2:
-	arr[idx/4].z = v;
-	break;
-      case 3:
-	arr[idx/4].w = v;
-	break;
-      }
+    uint64_t &w = arr[idx / per_word];
+    uint64_t sh = (idx % per_word) * Bits;
+    uint64_t v = (w >> sh) & max_value;
+    v += static_cast<uint64_t>(incr & (v != max_value));
+    v -= static_cast<uint64_t>(!incr & (v != 0));
+    w = (w & ~(max_value << sh)) | (v << sh);
   }
   uint64_t get_nentries() const {
     return n_entries;
   }
-  uint64_t count_valid() const {
-    return valid.popcount();
+  template <bool T = TrackValid>
+  typename std::enable_if<T, uint64_t>::type count_valid() const {
+    uint64_t c = 0;
+    for(uint64_t w : valid) {
+      c += __builtin_popcountll(w);
+    }
+    return c;
   }
 };
 
+template <uint32_t Bits, bool TrackValid>
+const uint64_t saturating_counter_array<Bits, TrackValid>::per_word;
+template <uint32_t Bits, bool TrackValid>
+const uint64_t saturating_counter_array<Bits, TrackValid>::max_value;
+
+/* the 2-bit tables predictors index; bimodal reports how much of
+ * its tables it touched */
+typedef saturating_counter_array<2> twobit_counter_array;
+typedef saturating_counter_array<2, true> tracked_twobit_counter_array;
+
 #endif
@@ -0,0 +1,228 @@
+#ifndef __FLATHASH_HH__
+#define __FLATHASH_HH__
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+#include "helper.hh"
+
+/* open-addressing (linear probing) table from uint64_t keys to
+ * small values. keys and values sit in two flat arrays, so a
+ * lookup is a hash and usually one cache line. ~0 is reserved
+ * as the empty key. with max_entries != 0 the table never holds
+ * more than that; a new key then evicts the entry in its home
+ * slot, or the next one after it */
+template <typename V>
+class flat_hash {
+private:
+  static const uint64_t empty_key = ~static_cast<uint64_t>(0);
+  std::vector<uint64_t> keys;
+  std::vector<V> vals;
+  uint64_t mask = 0, n_used = 0, max_entries = 0;
+  uint64_t n_inserts = 0, n_evictions = 0, n_grows = 0, peak = 0;
+
+  static uint64_t hash(uint64_t k) {
+    /* murmur3 finalizer */
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdUL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53UL;
+    k ^= k >> 33;
+    return k;
+  }
+  void alloc(uint64_t n_slots) {
+    keys.assign(n_slots, empty_key);
+    vals.assign(n_slots, V());
+    mask = n_slots - 1;
+  }
+  void grow() {
+    std::vector<uint64_t> old_keys;
+    std::vector<V> old_vals;
+    old_keys.swap(keys);
+    old_vals.swap(vals);
+    alloc(2 * old_keys.size());
+    for(size_t i = 0; i < old_keys.size(); i++) {
+      if(old_keys[i] != empty_key) {
+	uint64_t s = hash(old_keys[i]) & mask;
+	while(keys[s] != empty_key) {
+	  s = (s + 1) & mask;
+	}
+	keys[s] = old_keys[i];
+	vals[s] = old_vals[i];
+      }
+    }
+    n_grows++;
+  }
+  /* backward-shift delete, keeps every probe chain unbroken */
+  void erase_slot(uint64_t s) {
+    uint64_t hole = s;
+    for(uint64_t j = (s + 1) & mask; keys[j] != empty_key; j = (j + 1) & mask) {
+      uint64_t home = hash(keys[j]) & mask;
+      /* j can fill the hole if its home isn't in (hole, j] */
+      if(((j - home) & mask) >= ((j - hole) & mask)) {
+	keys[hole] = keys[j];
+	vals[hole] = vals[j];
+	hole = j;
+      }
+    }
+    keys[hole] = empty_key;
+    vals[hole] = V();
+    n_used--;
+  }
+public:
+  flat_hash(uint64_t max_entries = 0) : max_entries(max_entries) {
+    uint64_t n_slots = 64;
+    /* a capped table is sized once, at most 3/4 full */
+    while((max_entries != 0) and ((3 * n_slots) / 4 < max_entries)) {
+      n_slots *= 2;
+    }
+    alloc(n_slots);
+  }
+  V *find(uint64_t k) {
+    for(uint64_t s = hash(k) & mask; keys[s] != empty_key; s = (s + 1) & mask) {
+      if(keys[s] == k) {
+	return &vals[s];
+      }
+    }
+    return nullptr;
+  }
+  /* like std::map::operator[], new entries start as V() */
+  V &operator[](uint64_t k) {
+    if(k == empty_key) {
+      std::cerr << "flat_hash : key " << std::hex << k << std::dec << " is reserved\n";
+      die();
+    }
+    uint64_t s = hash(k) & mask;
+    for(; keys[s] != empty_key; s = (s + 1) & mask) {
+      if(keys[s] == k) {
+	return vals[s];
+      }
+    }
+    if((max_entries != 0) and (n_used == max_entries)) {
+      uint64_t v = hash(k) & mask;
+      while(keys[v] == empty_key) {
+	v = (v + 1) & mask;
+      }
+      erase_slot(v);
+      n_evictions++;
+      return (*this)[k];
+    }
+    if((4 * (n_used + 1)) > (3 * keys.size())) {
+      grow();
+      return (*this)[k];
+    }
+    keys[s] = k;
+    n_used++;
+    n_inserts++;
+    peak = (n_used > peak) ? n_used : peak;
+    return vals[s];
+  }
+  uint64_t size() const {
+    return n_used;
+  }
+  uint64_t capacity() const {
+    return keys.size();
+  }
+  uint64_t bytes() const {
+    return keys.size() * (sizeof(uint64_t) + sizeof(V));
+  }
+  friend std::ostream &operator<<(std::ostream &out, const flat_hash<V> &h) {
+    out << h.n_used << " entries (peak " << h.peak << ") in "
+	<< h.keys.size() << " slots, " << h.bytes() << " bytes, "
+	<< h.n_inserts << " inserts, " << h.n_evictions << " evictions, "
+	<< h.n_grows << " grows";
+    return out;
+  }
+};
+
+template <typename V> const uint64_t flat_hash<V>::empty_key;
+
+/* the same probing for keys of n_words 64-bit words, which are
+ * compared in full so distinct keys never share an entry. it
+ * only grows */
+template <typename V>
+class wide_hash {
+private:
+  uint64_t n_words, mask = 0, n_used = 0;
+  std::vector<uint64_t> keys;
+  std::vector<uint8_t> used;
+  std::vector<V> vals;
+
+  uint64_t hash(const uint64_t *k) const {
+    uint64_t h = 0x9e3779b97f4a7c15UL;
+    for(uint64_t i = 0; i < n_words; i++) {
+      h ^= k[i];
+      h *= 0xff51afd7ed558ccdUL;
+      h ^= h >> 33;
+    }
+    h *= 0xc4ceb9fe1a85ec53UL;
+    h ^= h >> 33;
+    return h;
+  }
+  bool same(uint64_t s, const uint64_t *k) const {
+    const uint64_t *e = &keys[s * n_words];
+    for(uint64_t i = 0; i < n_words; i++) {
+      if(e[i] != k[i]) {
+	return false;
+      }
+    }
+    return true;
+  }
+  void alloc(uint64_t n_slots) {
+    keys.assign(n_slots * n_words, 0);
+    used.assign(n_slots, 0);
+    vals.assign(n_slots, V());
+    mask = n_slots - 1;
+  }
+  uint64_t probe(const uint64_t *k) const {
+    uint64_t s = hash(k) & mask;
+    while(used[s] and not(same(s, k))) {
+      s = (s + 1) & mask;
+    }
+    return s;
+  }
+  void grow() {
+    std::vector<uint64_t> old_keys;
+    std::vector<uint8_t> old_used;
+    std::vector<V> old_vals;
+    old_keys.swap(keys);
+    old_used.swap(used);
+    old_vals.swap(vals);
+    alloc(2 * old_used.size());
+    for(size_t i = 0; i < old_used.size(); i++) {
+      if(old_used[i]) {
+	const uint64_t *k = &old_keys[i * n_words];
+	uint64_t s = probe(k);
+	std::copy(k, k + n_words, &keys[s * n_words]);
+	used[s] = 1;
+	vals[s] = old_vals[i];
+      }
+    }
+  }
+public:
+  wide_hash(uint64_t n_words) : n_words(n_words) {
+    alloc(64);
+  }
+  /* finds or inserts the key, new entries start as V(). the
+   * reference lasts until the next insert */
+  V &operator[](const uint64_t *k) {
+    uint64_t s = probe(k);
+    if(used[s]) {
+      return vals[s];
+    }
+    if((4 * (n_used + 1)) > (3 * used.size())) {
+      grow();
+      s = probe(k);
+    }
+    std::copy(k, k + n_words, &keys[s * n_words]);
+    used[s] = 1;
+    n_used++;
+    return vals[s];
+  }
+  uint64_t size() const {
+    return n_used;
+  }
+};
+
+#endif
@@ -0,0 +1 @@
+const char *githash = "c50b09204910b90c49339c46625a9efed96c1897";
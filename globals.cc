@@ -0,0 +1,6 @@
+#include "globals.hh"
+
+bool globals::enClockFuncts = false;
+bool globals::enableStackDepth = false;
+bool globals::threadedDispatch = false;
+uint32_t globals::jitThreshold = 0;
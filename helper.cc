@@ -1,4 +1,7 @@
 #include <cassert>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
 
 #include <sys/time.h>
 #include <time.h>
@@ -112,6 +115,37 @@ int32_t remapIOFlags(int32_t flags) {
   return nflags;
 }
 
+bool splitSpec(const std::string &spec, std::string *name, spec_pairs &kvs) {
+  std::stringstream ss(spec);
+  std::string tok;
+  bool first = true;
+  while(std::getline(ss, tok, ',')) {
+    size_t eq = tok.find('=');
+    if(eq == std::string::npos) {
+      if(not(first) or (name == nullptr)) {
+	return false;
+      }
+      *name = tok;
+    }
+    else {
+      kvs.emplace_back(tok.substr(0, eq), tok.substr(eq + 1));
+    }
+    first = false;
+  }
+  return true;
+}
+
+bool parseNumber(const std::string &s, uint64_t &val, uint64_t max) {
+  /* strtoull would skip spaces and negate after a '-' */
+  if(s.empty() or not(isdigit(static_cast<unsigned char>(s[0])))) {
+    return false;
+  }
+  char *end = nullptr;
+  errno = 0;
+  val = strtoull(s.c_str(), &end, 0);
+  return (*end == '\0') and (errno == 0) and (val <= max);
+}
+
 double timestamp() {
   struct timeval t;
   gettimeofday(&t,nullptr);
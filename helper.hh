@@ -5,6 +5,8 @@
 #include <vector>
 #include <cstdint>
 #include <iostream>
+#include <limits>
+#include <utility>
 
 #define KNRM  "\x1B[0m"
 #define KRED  "\x1B[31m"
@@ -36,6 +38,39 @@ uint32_t crc32(uint8_t *buf, size_t len);
 
 int32_t remapIOFlags(int32_t flags);
 
+/* marsaglia's xorshift32. every model that draws victims or
+ * allocations at random keeps its own, all seeded alike, so runs
+ * are repeatable */
+struct xorshift32 {
+  uint32_t x = 0x2545f491;
+  uint32_t next() {
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return x;
+  }
+};
+
+/* the key=value pairs of a spec written as [name,]key=value[,...].
+ * a leading word without '=' goes to name, and is an error when
+ * name is null or the word isn't first */
+typedef std::vector<std::pair<std::string, std::string>> spec_pairs;
+bool splitSpec(const std::string &spec, std::string *name, spec_pairs &kvs);
+
+/* a whole string holding an unsigned number no larger than max,
+ * in any base strtoull takes. false for anything else */
+bool parseNumber(const std::string &s, uint64_t &val, uint64_t max);
+
+template <typename T>
+bool parseNumber(const std::string &s, T &val) {
+  uint64_t v = 0;
+  if(not(parseNumber(s, v, std::numeric_limits<T>::max()))) {
+    return false;
+  }
+  val = static_cast<T>(v);
+  return true;
+}
+
 template <class T>
 std::string toString(T x) {
   return std::to_string(x);
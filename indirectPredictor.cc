@@ -0,0 +1,249 @@
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include "indirectPredictor.hh"
+#include "branch_predictor.hh"
+
+indirect_predictor::indirect_predictor(uint64_t &icnt) :
+  icnt(icnt) {}
+
+indirect_predictor::~indirect_predictor() {
+  delete hist;
+}
+
+bool indirect_predictor::jump(uint32_t pc, uint32_t target) {
+  n_jumps++;
+  uint32_t pred = predict(pc);
+  update(pc, target);
+  bool correct = (pred == target);
+  if(not(correct)) {
+    n_mispredicts++;
+    mispredict_map[pc]++;
+  }
+  if(hist) {
+    hist->push((target >> 2) & 1);
+    hist->push((target >> 3) & 1);
+  }
+  return correct;
+}
+
+indirect_predictor::ipred_impl indirect_predictor::lookup_impl(const std::string &impl_name) {
+  auto it = ipred_impl_map.find(impl_name);
+  if(it == ipred_impl_map.end()) {
+    return ipred_impl::unknown;
+  }
+  return it->second;
+}
+
+indirect_predictor *indirect_predictor::make(const ipred_config &c, uint64_t &icnt) {
+  switch(lookup_impl(c.impl))
+    {
+    case ipred_impl::ittage:
+      return new ittage(icnt, c);
+    default:
+    case ipred_impl::last_target:
+      break;
+    }
+  return new last_target(icnt, c);
+}
+
+#define PAIR(X) {#X, indirect_predictor::ipred_impl::X},
+const std::map<std::string, indirect_predictor::ipred_impl> indirect_predictor::ipred_impl_map = {
+  IPRED_IMPL_LIST(PAIR)
+};
+#undef PAIR
+
+ittage::ittage(uint64_t &icnt, const ipred_config &c) :
+  indirect_predictor(icnt),
+  base(c.lg_sz),
+  lg_sz(c.ittage_lg_sz),
+  tag_bits(c.ittage_tag_bits),
+  lg_u_period(c.ittage_lg_u_period) {
+  hist = new sim_history(c.ittage_max_hist);
+  const uint32_t n = c.ittage_tables;
+  std::vector<uint32_t> lens = geometric_lengths(n, c.ittage_min_hist, c.ittage_max_hist);
+  tables.resize(n);
+  for(uint32_t t = 0; t < n; t++) {
+    ittage_table &tt = tables[t];
+    tt.hist_len = lens[t];
+    tt.entries.assign(1U << lg_sz, ittage_entry{0,0,0,0});
+    tt.fold_idx = hist->add_fold(tt.hist_len, lg_sz);
+    tt.fold_tag0 = hist->add_fold(tt.hist_len, tag_bits);
+    tt.fold_tag1 = hist->add_fold(tt.hist_len, tag_bits - 1);
+  }
+  pred_table.resize(n+1, 0);
+  corr_pred_table.resize(n+1, 0);
+}
+
+ittage::~ittage() {
+  for(size_t h = 0; h < pred_table.size(); h++) {
+    double f = (pred_table[h] == 0) ? 100.0 :
+      (static_cast<double>(corr_pred_table[h]) / pred_table[h]) * 100.0;
+    std::cout << f << " percent correct "
+	      << pred_table[h] << " targets, "
+	      << corr_pred_table[h] << " correct from table len "
+	      << ((h==0) ? 0 : tables[h-1].hist_len) << "\n";
+  }
+}
+
+uint32_t ittage::predict(uint32_t addr) {
+  const uint32_t pc = addr >> 2;
+  const int n = static_cast<int>(tables.size());
+  provider = alt_provider = -1;
+  for(int t = n-1; t >= 0; t--) {
+    ittage_table &tt = tables[t];
+    tt.idx = (pc ^ (pc >> lg_sz) ^ hist->fold(tt.fold_idx)) & ((1U << lg_sz) - 1);
+    tt.tag = (pc ^ hist->fold(tt.fold_tag0) ^ (hist->fold(tt.fold_tag1) << 1)) &
+      ((1U << tag_bits) - 1);
+    if(tt.entries[tt.idx].tag == tt.tag) {
+      if(provider < 0) {
+	provider = t;
+      }
+      else if(alt_provider < 0) {
+	alt_provider = t;
+      }
+    }
+  }
+  alt_target = (alt_provider < 0) ? base.lookup(addr) :
+    tables[alt_provider].entries[tables[alt_provider].idx].target;
+  if(provider < 0) {
+    provider_target = pred_target = alt_target;
+    return pred_target;
+  }
+  const ittage_entry &e = tables[provider].entries[tables[provider].idx];
+  provider_target = e.target;
+  /* a fresh entry defers to the next longest hit */
+  pred_target = ((e.ctr == 0) and (alt_target != 0)) ? alt_target : provider_target;
+  return pred_target;
+}
+
+void ittage::update(uint32_t addr, uint32_t target) {
+  const int n = static_cast<int>(tables.size());
+  bool correct = (pred_target == target);
+
+  pred_table[provider + 1]++;
+  corr_pred_table[provider + 1] += correct;
+
+  if(provider >= 0) {
+    ittage_entry &e = tables[provider].entries[tables[provider].idx];
+    if(provider_target != alt_target) {
+      if(provider_target == target) {
+	e.u += (e.u != 3);
+      }
+      else if(alt_target == target) {
+	e.u -= (e.u != 0);
+      }
+    }
+    if(e.target == target) {
+      e.ctr += (e.ctr != 3);
+    }
+    else if(e.ctr != 0) {
+      e.ctr--;
+    }
+    else {
+      e.target = target;
+    }
+  }
+  base.update(addr, target);
+
+  if(not(correct) and (provider < (n-1))) {
+    int start = provider + 1;
+    if(((start + 1) < n) and ((rng.next() & 3) == 0)) {
+      start++;
+    }
+    bool done = false;
+    for(int t = start; t < n and not(done); t++) {
+      ittage_entry &e = tables[t].entries[tables[t].idx];
+      if(e.u == 0) {
+	e = ittage_entry{target, tables[t].tag, 0, 0};
+	done = true;
+      }
+    }
+    for(int t = start; t < n and not(done); t++) {
+      ittage_entry &e = tables[t].entries[tables[t].idx];
+      e.u--;
+    }
+  }
+
+  if((n_jumps & ((1UL << lg_u_period) - 1)) == 0) {
+    for(ittage_table &tt : tables) {
+      for(ittage_entry &e : tt.entries) {
+	e.u >>= 1;
+      }
+    }
+  }
+}
+
+std::ostream &operator<<(std::ostream &out, const indirect_predictor &ip) {
+  uint64_t n_j = 0, n_mis = 0, icnt = 0;
+  ip.get_stats(n_j, n_mis, icnt);
+  double r = (n_j == 0) ? 1.0 : static_cast<double>(n_j - n_mis) / n_j;
+  out << ip.getTypeString() << " : " << n_j << " indirect jumps\n";
+  out << (100.0*r) << "\% of indirect targets predicted correctly\n";
+  out << 1000.0 * (static_cast<double>(n_mis) / icnt)
+      << " indirect mispredicts per kilo insn\n";
+  return out;
+}
+
+bool ipred_config::set(const std::string &key, const std::string &v) {
+  if(key == "lg_sz") {
+    return parseNumber(v, lg_sz);
+  }
+  else if(key == "ittage_tables") {
+    return parseNumber(v, ittage_tables);
+  }
+  else if(key == "ittage_lg_sz") {
+    return parseNumber(v, ittage_lg_sz);
+  }
+  else if(key == "ittage_tag_bits") {
+    return parseNumber(v, ittage_tag_bits);
+  }
+  else if(key == "ittage_min_hist") {
+    return parseNumber(v, ittage_min_hist);
+  }
+  else if(key == "ittage_max_hist") {
+    return parseNumber(v, ittage_max_hist);
+  }
+  else if(key == "ittage_lg_u_period") {
+    return parseNumber(v, ittage_lg_u_period);
+  }
+  return false;
+}
+
+bool ipred_config::valid() const {
+  return (lg_sz != 0) and (lg_sz <= 24) and
+    (ittage_tables != 0) and (ittage_tables <= 16) and
+    (ittage_lg_sz != 0) and (ittage_lg_sz <= 24) and
+    (ittage_tag_bits >= 2) and (ittage_tag_bits <= 16) and
+    (ittage_min_hist != 0) and (ittage_min_hist <= ittage_max_hist) and
+    (ittage_lg_u_period != 0) and (ittage_lg_u_period <= 40);
+}
+
+bool ipred_config::parse(const std::string &spec) {
+  spec_pairs kvs;
+  if(not(splitSpec(spec, &impl, kvs)) or
+     (indirect_predictor::lookup_impl(impl) == indirect_predictor::ipred_impl::unknown)) {
+    return false;
+  }
+  for(const auto &kv : kvs) {
+    if(not(set(kv.first, kv.second))) {
+      return false;
+    }
+  }
+  return valid();
+}
+
+std::string ipred_config::str() const {
+  std::stringstream ss;
+  ss << impl << ",lg_sz=" << lg_sz;
+  if(impl == "ittage") {
+    ss << ",ittage_tables=" << ittage_tables
+       << ",ittage_lg_sz=" << ittage_lg_sz
+       << ",ittage_tag_bits=" << ittage_tag_bits
+       << ",ittage_min_hist=" << ittage_min_hist
+       << ",ittage_max_hist=" << ittage_max_hist
+       << ",ittage_lg_u_period=" << ittage_lg_u_period;
+  }
+  return ss.str();
+}
@@ -0,0 +1,160 @@
+#ifndef __INDIRECT_PREDICTOR_HH__
+#define __INDIRECT_PREDICTOR_HH__
+
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "sim_history.hh"
+#include "helper.hh"
+
+#define IPRED_IMPL_LIST(BA) \
+  BA(unknown)		    \
+  BA(last_target)	    \
+  BA(ittage)
+
+/* one indirect predictor configuration, written as
+ * impl[,key=value...] like bpred_config */
+struct ipred_config {
+  std::string impl = "last_target";
+  /* the pc-indexed last-target table, alone or as ittage's base */
+  uint32_t lg_sz = 10;
+  uint32_t ittage_tables = 6;
+  uint32_t ittage_lg_sz = 9;
+  uint32_t ittage_tag_bits = 11;
+  uint32_t ittage_min_hist = 4;
+  uint32_t ittage_max_hist = 64;
+  /* lg2 of jumps between resets of the useful bits */
+  uint32_t ittage_lg_u_period = 14;
+  bool parse(const std::string &spec);
+  bool set(const std::string &key, const std::string &val);
+  bool valid() const;
+  std::string str() const;
+};
+
+/* predicts the targets of register-indirect jumps (jr other than
+ * jr $31, jalr). an impl that indexes on history gives itself a
+ * hist, which then records conditional branch outcomes and, as a
+ * path history, two bits of each indirect target */
+class indirect_predictor {
+public:
+#define ITEM(X) X,
+  enum class ipred_impl {
+    IPRED_IMPL_LIST(ITEM)
+  };
+#undef ITEM
+  static const std::map<std::string, ipred_impl> ipred_impl_map;
+protected:
+  uint64_t &icnt;
+  sim_history *hist = nullptr;
+  uint64_t n_jumps = 0;
+  uint64_t n_mispredicts = 0;
+  std::map<uint32_t, uint64_t> mispredict_map;
+  /* the target the last predict returned, 0 when it had none */
+  virtual uint32_t predict(uint32_t pc) = 0;
+  virtual void update(uint32_t pc, uint32_t target) = 0;
+public:
+  indirect_predictor(uint64_t &icnt);
+  virtual ~indirect_predictor();
+  virtual const char *getTypeString() const = 0;
+  /* predicts, trains on and counts one jump. true when the
+   * predicted target was right */
+  bool jump(uint32_t pc, uint32_t target);
+  void branch(bool taken) {
+    if(hist) {
+      hist->push(taken);
+    }
+  }
+  void get_stats(uint64_t &n_j, uint64_t &n_mis, uint64_t &n_inst) const {
+    n_j = n_jumps;
+    n_mis = n_mispredicts;
+    n_inst = icnt;
+  }
+  const std::map<uint32_t, uint64_t> &getMap() const {
+    return mispredict_map;
+  }
+  static ipred_impl lookup_impl(const std::string &impl_name);
+  static indirect_predictor *make(const ipred_config &c, uint64_t &icnt);
+};
+
+/* the target each jump went to last time, in a direct-mapped
+ * table tagged with the full pc */
+class last_target_table {
+private:
+  struct entry {
+    uint32_t pc;
+    uint32_t target;
+  };
+  std::vector<entry> entries;
+  uint32_t mask;
+public:
+  last_target_table(uint32_t lg_sz) :
+    entries(1UL << lg_sz, entry{0,0}), mask((1U << lg_sz) - 1) {}
+  uint32_t lookup(uint32_t pc) const {
+    const entry &e = entries[(pc >> 2) & mask];
+    return (e.pc == pc) ? e.target : 0;
+  }
+  void update(uint32_t pc, uint32_t target) {
+    entries[(pc >> 2) & mask] = entry{pc, target};
+  }
+};
+
+class last_target : public indirect_predictor {
+protected:
+  constexpr static const char *typeString = "last_target";
+  last_target_table table;
+  uint32_t predict(uint32_t pc) override {
+    return table.lookup(pc);
+  }
+  void update(uint32_t pc, uint32_t target) override {
+    table.update(pc, target);
+  }
+public:
+  last_target(uint64_t &icnt, const ipred_config &c) :
+    indirect_predictor(icnt), table(c.lg_sz) {}
+  const char *getTypeString() const override {
+    return typeString;
+  }
+};
+
+/* ittage (Seznec) : tage's tables with a target and a 2-bit
+ * confidence counter in place of the direction counter, over a
+ * last-target base table */
+class ittage : public indirect_predictor {
+protected:
+  constexpr static const char *typeString = "ittage";
+  struct ittage_entry {
+    uint32_t target;
+    uint16_t tag;
+    uint8_t ctr;
+    uint8_t u;
+  };
+  struct ittage_table {
+    uint32_t hist_len;
+    size_t fold_idx, fold_tag0, fold_tag1;
+    std::vector<ittage_entry> entries;
+    uint32_t idx;
+    uint16_t tag;
+  };
+  std::vector<ittage_table> tables;
+  last_target_table base;
+  uint32_t lg_sz = 0, tag_bits = 0, lg_u_period = 0;
+  xorshift32 rng;
+  /* what the last predict saw */
+  int provider = -1, alt_provider = -1;
+  uint32_t provider_target = 0, alt_target = 0, pred_target = 0;
+  std::vector<uint64_t> pred_table, corr_pred_table;
+  uint32_t predict(uint32_t pc) override;
+  void update(uint32_t pc, uint32_t target) override;
+public:
+  ittage(uint64_t &icnt, const ipred_config &c);
+  ~ittage();
+  const char *getTypeString() const override {
+    return typeString;
+  }
+};
+
+std::ostream &operator<<(std::ostream &, const indirect_predictor &);
+
+#endif
@@ -0,0 +1,390 @@
+#include <cstddef>
+#include <cstring>
+#include <mutex>
+#include <vector>
+#include <sys/mman.h>
+
+#include "jitMips.hh"
+#include "simulation.hh"
+#include "simCache.hh"
+
+/* simulations on other threads share the code buffer */
+static std::mutex jit_lock;
+static uint64_t n_compiled = 0, n_rejected = 0;
+
+#ifdef __x86_64__
+
+bool haveJit() {
+  return true;
+}
+
+/* generated blocks are a plain function taking state_t* in rdi.
+ * registers pinned for the life of a block :
+ *   rbx : state_t*
+ *   r12 : guest memory base
+ *   r13 : effective address of the current load or store
+ * eax, ecx and edx are scratch. guest registers live in state_t
+ * between instructions, so handlers called from generated code
+ * see exactly what the interpreter would. */
+
+static const size_t code_buf_sz = 1UL<<26;
+static uint8_t *code_buf = nullptr;
+static size_t code_used = 0;
+
+static void jitRead(state_t *s, uint32_t ea, uint32_t sz) {
+  s->sim->L1D->read(ea, sz);
+}
+static void jitWrite(state_t *s, uint32_t ea, uint32_t sz) {
+  s->sim->L1D->write(ea, sz);
+  s->sim->bcache.check_store(ea, sz);
+}
+
+enum x86reg : uint8_t {eax = 0, ecx = 1, edx = 2};
+
+class x86Emitter {
+private:
+  std::vector<uint8_t> code;
+public:
+  void b(uint8_t x) {
+    code.push_back(x);
+  }
+  void d(uint32_t x) {
+    for(int i = 0; i < 4; i++) {
+      b(x >> (8*i));
+    }
+  }
+  void q(uint64_t x) {
+    d(x);
+    d(x >> 32);
+  }
+  /* opc r32, [rbx + disp32] */
+  void rm(uint8_t opc, x86reg r, uint32_t disp) {
+    b(opc);
+    b(0x80 | (r << 3) | 3);
+    d(disp);
+  }
+  void rm(uint8_t esc, uint8_t opc, x86reg r, uint32_t disp) {
+    b(esc);
+    rm(opc, r, disp);
+  }
+  void ld(x86reg r, uint32_t disp) {
+    rm(0x8b, r, disp);
+  }
+  void st(x86reg r, uint32_t disp) {
+    rm(0x89, r, disp);
+  }
+  /* mov dword [rbx + disp32], imm32 */
+  void sti(uint32_t disp, uint32_t imm) {
+    rm(0xc7, eax, disp);
+    d(imm);
+  }
+  /* setcc al; movzx eax, al */
+  void setcc(uint8_t cc) {
+    b(0x0f); b(0x90 | cc); b(0xc0);
+    b(0x0f); b(0xb6); b(0xc0);
+  }
+  void call(const void *fn) {
+    b(0x48); b(0xb8); q(reinterpret_cast<uint64_t>(fn));
+    b(0xff); b(0xd0);
+  }
+  void prologue() {
+    b(0x53);
+    b(0x41); b(0x54);
+    b(0x41); b(0x55);
+    b(0x48); b(0x89); b(0xfb);
+    b(0x4c); rm(0x8b, static_cast<x86reg>(4), offsetof(state_t, mem));
+  }
+  void epilogue() {
+    b(0x41); b(0x5d);
+    b(0x41); b(0x5c);
+    b(0x5b);
+    b(0xc3);
+  }
+  const std::vector<uint8_t> &bytes() const {
+    return code;
+  }
+};
+
+static uint32_t gprOff(uint32_t r) {
+  return offsetof(state_t, gpr) + 4*r;
+}
+
+static bool jitSupported(mips_op op) {
+  switch(op)
+    {
+    case mips_op::monitor:
+    case mips_op::coproc1x:
+      return false;
+    default:
+      break;
+    }
+  return getOpKind(op) != mips_op_kind::term;
+}
+
+/* leaves the effective address in r13d, tells the cache and
+ * checks stores against the decoded code */
+static void emitEA(x86Emitter &e, const decoded_insn *di, uint32_t sz, bool store) {
+  e.ld(eax, gprOff(di->rs));
+  e.b(0x05); e.d(di->imm);
+  e.b(0x41); e.b(0x89); e.b(0xc5);
+  e.b(0x48); e.b(0x89); e.b(0xdf);
+  e.b(0x44); e.b(0x89); e.b(0xee);
+  e.b(0xba); e.d(sz);
+  e.call(store ? reinterpret_cast<const void*>(&jitWrite) :
+	 reinterpret_cast<const void*>(&jitRead));
+}
+
+/* [r12 + r13*1] after an opcode */
+static void emitMemOperand(x86Emitter &e) {
+  e.b(0x04); e.b(0x2c);
+}
+
+/* emits inline code for di, returns false if it has to
+ * go through its handler */
+static bool emitInline(x86Emitter &e, const decoded_insn *di, bool el) {
+  switch(di->op)
+    {
+    case mips_op::sll:
+    case mips_op::srl:
+    case mips_op::sra: {
+      static const uint8_t ext[] = {0xe0, 0xe8, 0xf8};
+      e.ld(eax, gprOff(di->rt));
+      e.b(0xc1);
+      e.b(ext[static_cast<int>(di->op) - static_cast<int>(mips_op::sll)]);
+      e.b(di->sa);
+      e.st(eax, gprOff(di->rd));
+      break;
+    }
+    case mips_op::sllv:
+    case mips_op::srlv:
+    case mips_op::srav: {
+      static const uint8_t ext[] = {0xe0, 0xe8, 0xf8};
+      e.ld(ecx, gprOff(di->rs));
+      e.ld(eax, gprOff(di->rt));
+      e.b(0xd3);
+      e.b(ext[static_cast<int>(di->op) - static_cast<int>(mips_op::sllv)]);
+      e.st(eax, gprOff(di->rd));
+      break;
+    }
+    case mips_op::sync:
+      break;
+    case mips_op::mfhi:
+    case mips_op::mflo:
+      e.ld(eax, (di->op == mips_op::mfhi) ? offsetof(state_t, hi) : offsetof(state_t, lo));
+      e.st(eax, gprOff(di->rd));
+      break;
+    case mips_op::mthi:
+    case mips_op::mtlo:
+      e.ld(eax, gprOff(di->rs));
+      e.st(eax, (di->op == mips_op::mthi) ? offsetof(state_t, hi) : offsetof(state_t, lo));
+      break;
+    case mips_op::mult:
+    case mips_op::multu:
+      e.ld(eax, gprOff(di->rs));
+      /* imul or mul dword [rbx + rt] */
+      e.rm(0xf7, static_cast<x86reg>((di->op == mips_op::mult) ? 5 : 4), gprOff(di->rt));
+      e.st(eax, offsetof(state_t, lo));
+      e.st(edx, offsetof(state_t, hi));
+      break;
+    case mips_op::addu:
+    case mips_op::subu:
+    case mips_op::and_:
+    case mips_op::or_:
+    case mips_op::xor_:
+    case mips_op::nor: {
+      uint8_t opc = 0;
+      switch(di->op)
+	{
+	case mips_op::addu: opc = 0x03; break;
+	case mips_op::subu: opc = 0x2b; break;
+	case mips_op::and_: opc = 0x23; break;
+	case mips_op::xor_: opc = 0x33; break;
+	default: opc = 0x0b; break;
+	}
+      e.ld(eax, gprOff(di->rs));
+      e.rm(opc, eax, gprOff(di->rt));
+      if(di->op == mips_op::nor) {
+	e.b(0xf7); e.b(0xd0);
+      }
+      e.st(eax, gprOff(di->rd));
+      break;
+    }
+    case mips_op::slt:
+    case mips_op::sltu:
+      e.ld(eax, gprOff(di->rs));
+      e.rm(0x3b, eax, gprOff(di->rt));
+      e.setcc((di->op == mips_op::slt) ? 0xc : 0x2);
+      e.st(eax, gprOff(di->rd));
+      break;
+    case mips_op::movn:
+    case mips_op::movz:
+      e.ld(eax, gprOff(di->rd));
+      /* cmp dword [rbx + rt], 0 */
+      e.rm(0x83, static_cast<x86reg>(7), gprOff(di->rt));
+      e.b(0);
+      e.rm(0x0f, (di->op == mips_op::movn) ? 0x45 : 0x44, eax, gprOff(di->rs));
+      e.st(eax, gprOff(di->rd));
+      break;
+    case mips_op::addiu:
+    case mips_op::andi:
+    case mips_op::ori:
+    case mips_op::xori: {
+      uint8_t opc = 0;
+      switch(di->op)
+	{
+	case mips_op::addiu: opc = 0x05; break;
+	case mips_op::andi: opc = 0x25; break;
+	case mips_op::ori: opc = 0x0d; break;
+	default: opc = 0x35; break;
+	}
+      e.ld(eax, gprOff(di->rs));
+      e.b(opc); e.d(di->imm);
+      e.st(eax, gprOff(di->rt));
+      break;
+    }
+    case mips_op::slti:
+    case mips_op::sltiu:
+      e.ld(eax, gprOff(di->rs));
+      e.b(0x3d); e.d(di->imm);
+      e.setcc((di->op == mips_op::slti) ? 0xc : 0x2);
+      e.st(eax, gprOff(di->rt));
+      break;
+    case mips_op::lui:
+      e.sti(gprOff(di->rt), di->imm);
+      break;
+      /* lbu and lhu sign extend in the interpreter too */
+    case mips_op::lw:
+    case mips_op::lh:
+    case mips_op::lhu:
+    case mips_op::lb:
+    case mips_op::lbu:
+      if(di->op == mips_op::lw) {
+	emitEA(e, di, 4, false);
+	e.b(0x43); e.b(0x8b); emitMemOperand(e);
+	if(not(el)) {
+	  e.b(0x0f); e.b(0xc8);
+	}
+      }
+      else if((di->op == mips_op::lh) or (di->op == mips_op::lhu)) {
+	emitEA(e, di, 2, false);
+	if(el) {
+	  e.b(0x43); e.b(0x0f); e.b(0xbf); emitMemOperand(e);
+	}
+	else {
+	  e.b(0x43); e.b(0x0f); e.b(0xb7); emitMemOperand(e);
+	  e.b(0x66); e.b(0xc1); e.b(0xc0); e.b(8);
+	  e.b(0x0f); e.b(0xbf); e.b(0xc0);
+	}
+      }
+      else {
+	emitEA(e, di, 1, false);
+	e.b(0x43); e.b(0x0f); e.b(0xbe); emitMemOperand(e);
+      }
+      e.st(eax, gprOff(di->rt));
+      break;
+    case mips_op::sw:
+      emitEA(e, di, 4, true);
+      e.ld(eax, gprOff(di->rt));
+      if(not(el)) {
+	e.b(0x0f); e.b(0xc8);
+      }
+      e.b(0x43); e.b(0x89); emitMemOperand(e);
+      break;
+    case mips_op::sh:
+      emitEA(e, di, 2, true);
+      e.ld(eax, gprOff(di->rt));
+      if(not(el)) {
+	e.b(0x66); e.b(0xc1); e.b(0xc0); e.b(8);
+      }
+      e.b(0x66); e.b(0x43); e.b(0x89); emitMemOperand(e);
+      break;
+    case mips_op::sb:
+      emitEA(e, di, 1, true);
+      e.ld(eax, gprOff(di->rt));
+      e.b(0x43); e.b(0x88); emitMemOperand(e);
+      break;
+    default:
+      return false;
+    }
+  return true;
+}
+
+mips_native jitCompile(const mips_block *b, bool el) {
+  std::lock_guard<std::mutex> lk(jit_lock);
+  for(uint32_t i = 0; i < b->n_issue; i++) {
+    if(not(jitSupported(b->insns[i].op))) {
+      n_rejected++;
+      return nullptr;
+    }
+  }
+  x86Emitter e;
+  e.prologue();
+  /* s->pc is only stored before a handler needs it and
+   * at the end of the block */
+  bool pc_synced = true;
+  for(uint32_t i = 0; i < b->n_issue; i++) {
+    const decoded_insn *di = &b->insns[i];
+    uint32_t pc = b->pc + 4*i;
+    if(emitInline(e, di, el)) {
+      pc_synced = false;
+      continue;
+    }
+    if(not(pc_synced)) {
+      e.sti(offsetof(state_t, pc), pc);
+    }
+    e.b(0x48); e.b(0xbf); e.q(reinterpret_cast<uint64_t>(di));
+    e.b(0x48); e.b(0x89); e.b(0xde);
+    e.call(reinterpret_cast<const void*>(di->handler));
+    pc_synced = true;
+  }
+  if(not(pc_synced)) {
+    e.sti(offsetof(state_t, pc), b->pc + 4*b->n_issue);
+  }
+  e.epilogue();
+
+  const std::vector<uint8_t> &code = e.bytes();
+  if(code_buf == nullptr) {
+    void *p = mmap(nullptr, code_buf_sz, PROT_READ|PROT_WRITE|PROT_EXEC,
+		   MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if(p == MAP_FAILED) {
+      n_rejected++;
+      return nullptr;
+    }
+    code_buf = reinterpret_cast<uint8_t*>(p);
+  }
+  if((code_used + code.size()) > code_buf_sz) {
+    n_rejected++;
+    return nullptr;
+  }
+  uint8_t *fn = code_buf + code_used;
+  memcpy(fn, code.data(), code.size());
+  /* keep blocks 16-byte aligned */
+  code_used = (code_used + code.size() + 15) & ~static_cast<size_t>(15);
+  n_compiled++;
+  return reinterpret_cast<mips_native>(fn);
+}
+
+#else
+
+bool haveJit() {
+  return false;
+}
+
+mips_native jitCompile(const mips_block *b, bool el) {
+  std::lock_guard<std::mutex> lk(jit_lock);
+  n_rejected++;
+  return nullptr;
+}
+
+#endif
+
+std::ostream &jitStats(std::ostream &out) {
+  std::lock_guard<std::mutex> lk(jit_lock);
+  out << "jit : " << n_compiled << " blocks compiled, "
+      << n_rejected << " left to the interpreter";
+#ifdef __x86_64__
+  out << ", " << code_used << " bytes of code";
+#endif
+  out << "\n";
+  return out;
+}
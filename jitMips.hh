@@ -0,0 +1,16 @@
+#ifndef __JIT_MIPS_HH__
+#define __JIT_MIPS_HH__
+
+#include <ostream>
+#include "blockCache.hh"
+
+bool haveJit();
+
+/* translates the issued instructions of a decoded block (not
+ * its delay slot) into native code. returns nullptr for blocks
+ * the jit doesn't handle, which stay in the interpreter */
+mips_native jitCompile(const mips_block *b, bool el);
+
+std::ostream &jitStats(std::ostream &out);
+
+#endif
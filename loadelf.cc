@@ -15,7 +15,7 @@
 
 #include "helper.hh"
 #include "profileMips.hh"
-#include "globals.hh"
+#include "simulation.hh"
 
 #ifdef __APPLE__
 #include "TargetConditionals.h"
@@ -29,32 +29,32 @@
 #define INTEGRAL_ENABLE_IF(SZ,T) typename std::enable_if<std::is_integral<T>::value and (sizeof(T)==SZ),T>::type* = nullptr
 
 template <typename T, INTEGRAL_ENABLE_IF(1,T)>
-T bswap_(T x) {
+T bswap_(T x, bool el) {
   return x;
 }
 
 template <typename T, INTEGRAL_ENABLE_IF(2,T)> 
-T bswap_(T x) {
+T bswap_(T x, bool el) {
   static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "must be little endian machine");
-  if(globals::isMipsEL) 
+  if(el) 
     return x;
   else
   return  __builtin_bswap16(x);
 }
 
 template <typename T, INTEGRAL_ENABLE_IF(4,T)>
-T bswap_(T x) {
+T bswap_(T x, bool el) {
   static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "must be little endian machine");
-  if(globals::isMipsEL)
+  if(el)
     return x;
   else 
     return  __builtin_bswap32(x);
 }
 
 template <typename T, INTEGRAL_ENABLE_IF(8,T)> 
-T bswap_(T x) {
+T bswap_(T x, bool el) {
   static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "must be little endian machine");
-  if(globals::isMipsEL)
+  if(el)
     return x;
   else 
     return  __builtin_bswap64(x);
@@ -112,37 +112,39 @@ void load_elf(const char* fn, state_t *ms) {
   }
 
   /* Check for a MIPS machine */
+  bool el = false;
   if(checkLittleEndian(eh32)) {
-    globals::isMipsEL = true;
+    el = true;
   }
   else if(checkBigEndian(eh32)) {
-    globals::isMipsEL = false;
+    el = false;
   }
   else {
     std::cerr << "not big or little little endian?\n";
     die();
   }
-  if(bswap_(eh32->e_machine) != 8) {
+  ms->sim->isMipsEL = el;
+  if(bswap_(eh32->e_machine, el) != 8) {
     printf("INTERP : non-mips binary..goodbye\n");
     exit(-1);
   }
 
-  uint32_t lAddr = bswap_(eh32->e_entry);
+  uint32_t lAddr = bswap_(eh32->e_entry, el);
 
-  e_phnum = bswap_(eh32->e_phnum);
-  ph32 = (Elf32_Phdr*)(buf + bswap_(eh32->e_phoff));
-  e_shnum = bswap_(eh32->e_shnum);
-  sh32 = (Elf32_Shdr*)(buf + bswap_(eh32->e_shoff));
+  e_phnum = bswap_(eh32->e_phnum, el);
+  ph32 = (Elf32_Phdr*)(buf + bswap_(eh32->e_phoff, el));
+  e_shnum = bswap_(eh32->e_shnum, el);
+  sh32 = (Elf32_Shdr*)(buf + bswap_(eh32->e_shoff, el));
   ms->pc = lAddr;
 
   /* Find instruction segments and copy to
    * the memory buffer */
   for(int32_t i = 0; i < e_phnum; i++, ph32++) {
-    int32_t p_memsz = bswap_(ph32->p_memsz);
-    int32_t p_offset = bswap_(ph32->p_offset);
-    int32_t p_filesz = bswap_(ph32->p_filesz);
-    int32_t p_type = bswap_(ph32->p_type);
-    uint32_t p_vaddr = bswap_(ph32->p_vaddr);
+    int32_t p_memsz = bswap_(ph32->p_memsz, el);
+    int32_t p_offset = bswap_(ph32->p_offset, el);
+    int32_t p_filesz = bswap_(ph32->p_filesz, el);
+    int32_t p_type = bswap_(ph32->p_type, el);
+    uint32_t p_vaddr = bswap_(ph32->p_vaddr, el);
     if(p_type == SHT_PROGBITS && p_memsz) {
       if( (p_vaddr + p_memsz) > lAddr)
 	lAddr = (p_vaddr + p_memsz);
@@ -157,10 +159,10 @@ void load_elf(const char* fn, state_t *ms) {
    * metadata (DBS_PROT_INSN) that these
    * are instructions */
   for(int32_t i = 0; i < e_shnum; i++, sh32++) {
-    int32_t f = bswap_(sh32->sh_flags);
+    int32_t f = bswap_(sh32->sh_flags, el);
     if(f & SHF_EXECINSTR) {
-      uint32_t addr = bswap_(sh32->sh_addr);
-      int32_t size = bswap_(sh32->sh_size);
+      uint32_t addr = bswap_(sh32->sh_addr, el);
+      int32_t size = bswap_(sh32->sh_size, el);
       bool pgAligned = ((addr & 4095) == 0);
       if(pgAligned) {
 	size = (size / pgSize) * pgSize;
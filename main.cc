@@ -25,25 +25,14 @@
 #include "sim_bitvec.hh"
 #include "branch_predictor.hh"
 #include "simCache.hh"
+#include "jitMips.hh"
+#include "branchTrace.hh"
+#include "branchTargetBuffer.hh"
+#include "returnStack.hh"
+#include "simulation.hh"
 
 extern const char* githash;
 
-char **globals::sysArgv = nullptr;
-int globals::sysArgc = 0;
-bool globals::enClockFuncts = false;
-bool globals::isMipsEL = false;
-uint32_t globals::rsb_sz = 0;
-uint32_t globals::rsb_tos = 0;
-uint32_t * globals::rsb = nullptr;
-uint64_t globals::num_jr_r31 = 0;
-uint64_t globals::num_jr_r31_mispred = 0;
-
-sim_bitvec* globals::bhr = nullptr;
-branch_predictor* globals::bpred = nullptr;
-state_t* globals::state = nullptr;
-simCache* globals::L1D = nullptr;
-bool globals::enableStackDepth = false;
-
 template<typename X, typename Y>
 static inline void dump_histo(const std::string &fname,
 			      const std::map<X,Y> &histo,
@@ -55,46 +44,17 @@ static inline void dump_histo(const std::string &fname,
   std::ofstream out(fname);
   std::sort(sorted_by_cnt.begin(), sorted_by_cnt.end());
   for(auto it = sorted_by_cnt.rbegin(), E = sorted_by_cnt.rend(); it != E; ++it) {
-    uint32_t r_inst = *reinterpret_cast<uint32_t*>(globals::state->mem + it->second);
+    uint32_t r_inst = *reinterpret_cast<uint32_t*>(s->mem + it->second);
     r_inst = bswap<false>(r_inst);	
-    auto s = getAsmString(r_inst, it->second);
+    auto a = getAsmString(r_inst, it->second);
     out << std::hex << it->second << ":"
-  	      << s << ","
+  	      << a << ","
   	      << std::dec << it->first << "\n";
   }
   out.close();
 }
 
 
-static int buildArgcArgv(const char *filename, const std::string &sysArgs, char **&argv){
-  int cnt = 0;
-  std::vector<std::string> args;
-  char **largs = 0;
-  args.push_back(std::string(filename));
-
-  char *ptr = nullptr;
-  char *c_str = strdup(sysArgs.c_str());
-  if(sysArgs.size() != 0)
-    ptr = strtok(c_str, " ");
-
-  while(ptr && (cnt<MARGS)) {
-    args.push_back(std::string(ptr));
-    ptr = strtok(nullptr, " ");
-    cnt++;
-  }
-  largs = new char*[args.size()];
-  for(size_t i = 0; i < args.size(); i++) {
-    const std::string & s = args[i];
-    size_t l = strlen(s.c_str());
-    largs[i] = new char[l+1];
-    memset(largs[i],0,sizeof(char)*(l+1));
-    memcpy(largs[i],s.c_str(),sizeof(char)*l);
-  }
-  argv = largs;
-  free(c_str);
-  return (int)args.size();
-}
-
 int main(int argc, char *argv[]) {
   bool bigEndianMips = true;
   namespace po = boost::program_options; 
@@ -107,13 +67,16 @@ int main(int argc, char *argv[]) {
     	    << "git hash=" << githash
 	    << KNRM << "\n";
   
-  size_t pgSize = getpagesize();
-  std::string sysArgs, filename, bpred_impl;
+  std::string sysArgs, filename, bpred_impl, ipred_spec, btb_spec, rsb_spec, dispatch, trace_out;
+  std::string repl_spec, mem_trace, l2_spec, llc_spec, write_policy;
+  int mem_latency;
+  bool write_allocate;
+  std::vector<std::string> bpred_specs;
   uint64_t maxinsns = ~(0UL);
-  bool hash = false,loaddump = false;
+  bool hash = false,loaddump = false, jit = false;
   int32_t assoc, l1d_sets, line_len;
   size_t bhr_len;
-  uint32_t lg_pht_sz, lg_c_pht_sz, lg_rsb_sz,pc_shift;
+  uint32_t lg_pht_sz, lg_c_pht_sz, lg_rsb_sz,pc_shift,jit_thresh;
   po::options_description desc("Options");
   po::variables_map vm;
   
@@ -131,10 +94,25 @@ int main(int argc, char *argv[]) {
       ("lg_rsb_sz", po::value<uint32_t>(&lg_rsb_sz)->default_value(2), "lg2(rsb) sz")
       ("lg_c_pht_sz", po::value<uint32_t>(&lg_c_pht_sz)->default_value(16), "lg2(choice pht) sz (bimodal predictor)")
       ("bpred_impl", po::value<std::string>(&bpred_impl), "branch predictor (string)")
+      ("bpred", po::value<std::vector<std::string>>(&bpred_specs)->composing(), "add a predictor as impl[,key=value...], repeat to run several at once")
+      ("ipred", po::value<std::string>(&ipred_spec)->default_value("last_target"), "indirect jump predictor as impl[,key=value...]")
+      ("rsb", po::value<std::string>(&rsb_spec)->default_value(""), "return stack as key=value[,...] (depth, policy, valid_bits), depth overrides lg_rsb_sz")
+      ("btb", po::value<std::string>(&btb_spec), "model a btb with geometry key=value[,...] (lg_entries, ways, tag_bits, repl), \"\" for the defaults")
       ("assoc", po::value<int32_t>(&assoc)->default_value(-1), "cache associativity")
       ("sets", po::value<int32_t>(&l1d_sets)->default_value(64), "cache sets")
+      ("repl", po::value<std::string>(&repl_spec)->default_value("lru"), "cache replacement as policy[,key=value...] (lru, plru, nru, random, srrip, brrip, drrip, opt,trace=file)")
+      ("write", po::value<std::string>(&write_policy)->default_value("back"), "cache write policy (back or through)")
+      ("write_allocate", po::value<bool>(&write_allocate)->default_value(true), "fill the cache on a write miss")
+      ("mem_trace", po::value<std::string>(&mem_trace), "write the cache's accesses to this file for a later opt run")
+      ("l2", po::value<std::string>(&l2_spec), "add an l2 below the cache as key=value[,...] (sets, assoc, latency, inclusion=nine|inclusive|exclusive, write=back|through, write_allocate, repl and its keys)")
+      ("llc", po::value<std::string>(&llc_spec), "add a last-level cache below the l2 or the cache, written like --l2")
+      ("mem_latency", po::value<int>(&mem_latency)->default_value(100), "memory latency behind the last level, for amat")
       ("line_len", po::value<int32_t>(&line_len)->default_value(16), "cache line length")
       ("pc_shift", po::value<uint32_t>(&pc_shift)->default_value(3), "shift dist pc in gshare")
+      ("dispatch", po::value<std::string>(&dispatch)->default_value("threaded"), "interpreter dispatch (switch or threaded)")
+      ("jit", po::value<bool>(&jit)->default_value(false), "compile hot blocks to native code")
+      ("jit_thresh", po::value<uint32_t>(&jit_thresh)->default_value(64), "block entries before compiling")
+      ("trace_out", po::value<std::string>(&trace_out), "write a branch trace to this file")
       ; 
     po::store(po::parse_command_line(argc, argv, desc), vm);
     po::notify(vm); 
@@ -149,138 +127,223 @@ int main(int argc, char *argv[]) {
     return 0;
   }
 
-  globals::rsb_sz = 1U << lg_rsb_sz;
-  globals::rsb = new uint32_t[globals::rsb_sz];
-  globals::rsb_tos = (globals::rsb_sz - 1) & (globals::rsb_sz - 1);
-  
-  memset(globals::rsb, 0, sizeof(uint32_t)*globals::rsb_sz);
-  
+  if(dispatch == "threaded") {
+    globals::threadedDispatch = haveThreadedDispatch();
+    if(not(globals::threadedDispatch)) {
+      std::cerr << KRED << "threaded dispatch not built, using switch" << KNRM << "\n";
+    }
+  }
+  else if(dispatch != "switch") {
+    std::cerr << KRED << "unknown dispatch " << dispatch << KNRM << "\n";
+    return -1;
+  }
+
+  if(jit) {
+    if(haveJit()) {
+      globals::jitThreshold = std::max(1U, jit_thresh);
+    }
+    else {
+      std::cerr << KRED << "no jit for this host, interpreting" << KNRM << "\n";
+    }
+  }
+
   if(filename.size()==0) {
     std::cerr << "INTERP : no file\n";
     return -1;
   }
-   
+
+  simulation *sim = new simulation();
+  if(not(sim->init(maxinsns))) {
+    std::cerr << "INTERP : couldn't allocate backing memory!\n";
+    exit(-1);
+  }
+  rsb_config rc;
+  rc.depth = 1U << lg_rsb_sz;
+  if(not(rc.parse(rsb_spec))) {
+    std::cerr << KRED << "bad rsb config " << rsb_spec << KNRM << "\n";
+    return -1;
+  }
+  sim->setRSB(rc);
   /* Build argc and argv */
-  globals::sysArgc = buildArgcArgv(filename.c_str(),sysArgs,globals::sysArgv);
+  sim->setArgs(filename.c_str(), sysArgs);
   initParseTables();
 
-  int rc = posix_memalign((void**)&globals::state, pgSize, pgSize); 
-  initState(globals::state);
-  globals::state->maxicnt = maxinsns;
-
-
-
-  switch(branch_predictor::lookup_impl(bpred_impl))
-    {
-    case branch_predictor::bpred_impl::bimodal:
-      globals::bpred = new bimodal(globals::state->icnt,lg_c_pht_sz,lg_pht_sz);
-      break;      
-    case branch_predictor::bpred_impl::gtagged:
-      globals::bpred = new gtagged(globals::state->icnt);
-      break;
-    case branch_predictor::bpred_impl::uberhistory:
-      globals::bpred = new uberhistory(globals::state->icnt,lg_pht_sz);
-      break;
-    case branch_predictor::bpred_impl::tage:
-      globals::bpred = new tage(globals::state->icnt,lg_pht_sz);
-      break;
-    default:            
-    case branch_predictor::bpred_impl::gshare:
-      globals::bpred = new gshare(globals::state->icnt,lg_pht_sz,pc_shift);
-      break;
-      
-    }
-
-  if(globals::bpred->needed_history_length()) {
-    bhr_len = globals::bpred->needed_history_length();
+  bpred_config base_config;
+  if(branch_predictor::lookup_impl(bpred_impl) != branch_predictor::bpred_impl::unknown) {
+    base_config.impl = bpred_impl;
+  }
+  base_config.lg_pht_sz = lg_pht_sz;
+  base_config.lg_c_pht_sz = lg_c_pht_sz;
+  base_config.pc_shift = pc_shift;
+  base_config.bhr_len = bhr_len;
+  if(not(base_config.valid())) {
+    std::cerr << KRED << "bad predictor config " << base_config.str() << KNRM << "\n";
+    return -1;
   }
-  globals::bhr = new sim_bitvec(bhr_len);
-  
   
-#ifdef __linux__
-  void* mempt = mmap(nullptr, 1UL<<32, PROT_READ | PROT_WRITE,
-		     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
-#else
-  void* mempt = mmap(nullptr, 1UL<<32, PROT_READ | PROT_WRITE,
-		     MAP_PRIVATE | MAP_ANONYMOUS , -1, 0);
-#endif
-  assert(mempt != reinterpret_cast<void*>(-1));
-  assert(madvise(mempt, 1UL<<32, MADV_DONTNEED)==0);
-  globals::state->mem = reinterpret_cast<uint8_t*>(mempt);
-  if(globals::state->mem == nullptr) {
-    std::cerr << "INTERP : couldn't allocate backing memory!\n";
-    exit(-1);
+  if(bpred_specs.empty()) {
+    sim->addPredictor(base_config);
+  }
+  for(const std::string &spec : bpred_specs) {
+    bpred_config c = base_config;
+    if(not(c.parse(spec))) {
+      std::cerr << KRED << "bad predictor config " << spec << KNRM << "\n";
+      return -1;
+    }
+    sim->addPredictor(c);
+  }
+  ipred_config ic;
+  if(not(ic.parse(ipred_spec))) {
+    std::cerr << KRED << "bad indirect predictor config " << ipred_spec << KNRM << "\n";
+    return -1;
+  }
+  sim->predictors.set_indirect(ic, sim->state->icnt);
+  if(vm.count("btb")) {
+    btb_config bc;
+    if(not(bc.parse(btb_spec))) {
+      std::cerr << KRED << "bad btb config " << btb_spec << KNRM << "\n";
+      return -1;
+    }
+    sim->btb = new branch_target_buffer(bc, sim->state->icnt);
   }
 
   if(loaddump) {
-    loadState(*globals::state, filename.c_str());
-    globals::state->icnt = 0;
-    //std::cout << "state loaded with " << globals::state->icnt << " executed insns\n";
+    loadState(*sim->state, filename.c_str());
+    sim->state->icnt = 0;
+    //std::cout << "state loaded with " << sim->state->icnt << " executed insns\n";
  }
  else {
-   load_elf(filename.c_str(), globals::state);
-   mkMonitorVectors(globals::state);
+   load_elf(filename.c_str(), sim->state);
+   mkMonitorVectors(sim->state);
  }
-  if(assoc <= -0) {
-    globals::L1D = new simCache(line_len, 1, l1d_sets, "l1D", 1, nullptr);
+  repl_config cc;
+  if(not(cc.parse(repl_spec))) {
+    std::cerr << KRED << "bad replacement policy " << repl_spec << KNRM << "\n";
+    return -1;
   }
-  else if(assoc==1) {
-    globals::L1D = new directMappedCache(line_len, 1, l1d_sets, "l1D", 1, nullptr);
+  if(write_policy != "back" and write_policy != "through") {
+    std::cerr << KRED << "unknown write policy " << write_policy << KNRM << "\n";
+    return -1;
   }
-  else if(l1d_sets==1) {
-    globals::L1D = new fullAssocCache(line_len, assoc, 1, "l1D", 1, nullptr);
+  /* built from the bottom up, each level owns the one below */
+  simCache *lower = nullptr;
+  /* the level above an exclusive one must hand it every line it
+   * drops, so it can't let writes past without allocating */
+  bool lower_exclusive = false;
+  const std::vector<std::pair<std::string, std::string>> levels = {
+    {"llc", llc_spec}, {"l2", l2_spec}
+  };
+  for(const auto &lv : levels) {
+    if(lv.second.empty()) {
+      continue;
+    }
+    cache_config lc;
+    if(lv.first == "llc") {
+      lc.sets = 2048;
+      lc.assoc = 16;
+      lc.latency = 40;
+    }
+    if(assoc <= 0 or not(lc.parse(lv.second))) {
+      std::cerr << KRED << "bad " << lv.first << " config " << lv.second
+		<< ", which also needs --assoc" << KNRM << "\n";
+      return -1;
+    }
+    if(lower_exclusive and not(lc.write_back and lc.write_allocate)) {
+      std::cerr << KRED << lv.first << " is above an exclusive level, so it needs "
+		<< "write=back,write_allocate=1" << KNRM << "\n";
+      return -1;
+    }
+    lower = simCache::make(line_len, lc.assoc, lc.sets, lv.first, lc.latency, lower, lc.repl);
+    lower->set_inclusion(simCache::inclusion_map.at(lc.inclusion));
+    lower->set_write_policy(lc.write_back, lc.write_allocate);
+    lower_exclusive = (lc.inclusion == "exclusive");
+  }
+  if(lower_exclusive and not((write_policy == "back") and write_allocate)) {
+    std::cerr << KRED << "the cache is above an exclusive level, so it needs "
+	      << "--write back --write_allocate 1" << KNRM << "\n";
+    return -1;
+  }
+  if(assoc <= -0) {
+    sim->L1D = new simCache(line_len, 1, l1d_sets, "l1D", 1, nullptr);
   }
   else {
-    globals::L1D = new setAssocCache(line_len, assoc, l1d_sets,  "l1D", 1, nullptr);
+    sim->L1D = simCache::make(line_len, assoc, l1d_sets, "l1D", 1, lower, cc);
+    sim->L1D->set_write_policy(write_policy == "back", write_allocate);
+  }
+  for(simCache *c = sim->L1D; c != nullptr; c = c->get_next_level()) {
+    c->set_mem_latency(mem_latency);
+  }
+  if(not(mem_trace.empty())) {
+    sim->L1D->set_trace(mem_trace);
   }
   
-  double runtime = timestamp();
-  if(globals::isMipsEL) {
-    while(globals::state->brk==0 and (globals::state->icnt < globals::state->maxicnt)) {
-      execMipsEL(globals::state);
-    }
+  if(not(trace_out.empty())) {
+    sim->trace = new branchTraceWriter(trace_out);
   }
-  else {
-    while(globals::state->brk==0 and (globals::state->icnt < globals::state->maxicnt)) {
-      execMips(globals::state);
-    }
+  
+  double runtime = timestamp();
+  while(sim->state->brk==0 and (sim->state->icnt < sim->state->maxicnt)) {
+    execMipsN(sim, sim->state->maxicnt - sim->state->icnt);
   }
   runtime = timestamp()-runtime;
   
   if(hash) {
     std::fflush(nullptr);
-    std::cerr << *globals::state << "\n";
+    std::cerr << *sim->state << "\n";
     std::cerr << "crc32=" << std::hex
-	      << crc32(globals::state->mem, 1UL<<32)<<std::dec
+	      << crc32(sim->state->mem, 1UL<<32)<<std::dec
 	      << "\n";
   } 
   std::cerr << KGRN << "INTERP: "
 	    << runtime << " sec, "
-	    << globals::state->icnt << " ins executed, "
-	    << (globals::state->icnt/runtime)*1e-6 << "  megains / sec"
+	    << sim->state->icnt << " ins executed, "
+	    << (sim->state->icnt/runtime)*1e-6 << "  megains / sec ("
+	    << (globals::threadedDispatch ? "threaded" : "switch") << " dispatch)"
 	    << KNRM  << "\n";
     
-  std::cerr <<  *(globals::bpred) << "\n";
+  if(globals::jitThreshold) {
+    jitStats(std::cerr);
+  }
+  if(sim->trace) {
+    sim->trace->close(sim->state->icnt);
+    std::cerr << "trace : " << sim->trace->records() << " records, "
+	      << sim->trace->bytes() << " bytes written to "
+	      << trace_out << "\n";
+  }
+  if(sim->predictors.size() == 1) {
+    std::cerr <<  *(sim->bpred) << "\n";
+  }
+  else {
+    std::cerr << sim->predictors;
+  }
 
-  std::cerr << "num jr r31 = " << globals::num_jr_r31 << "\n";
-  std::cerr << "num mispredicted jr r31 = " << globals::num_jr_r31_mispred
+  std::cerr << "num jr r31 = " << sim->rsb->pops() << "\n";
+  std::cerr << "num mispredicted jr r31 = " << sim->rsb->mispredicts()
 	    << "\n";
-
-  dump_histo("mispredicts.txt", globals::bpred->getMap(), globals::state);
-  
-  munmap(mempt, 1UL<<32);
-  if(globals::sysArgv) {
-    for(int i = 0; i < globals::sysArgc; i++) {
-      delete [] globals::sysArgv[i];
+  std::cerr << *sim->rsb;
+  if(assoc > 0) {
+    /* lines still dirty at exit count as writebacks, and each
+     * level's go to the one below before that one is flushed */
+    for(simCache *c = sim->L1D; c != nullptr; c = c->get_next_level()) {
+      c->flush();
     }
-    delete [] globals::sysArgv;
+    std::cerr << *sim->L1D;
+  }
+
+  std::cerr << *sim->predictors.indirect();
+  if(sim->btb) {
+    std::cerr << *sim->btb;
+  }
+
+  dump_histo("mispredicts.txt", sim->bpred->getMap(), sim->state);
+  dump_histo("indirect_mispredicts.txt", sim->predictors.indirect()->getMap(), sim->state);
+  dump_histo("rsb_mispredicts.txt", sim->rsb->getMap(), sim->state);
+  if(sim->btb) {
+    dump_histo("btb_mispredicts.txt", sim->btb->getMap(), sim->state);
   }
-  free(globals::state);
-  delete globals::bhr;
-  delete globals::bpred;
-  delete [] globals::rsb;
-  delete globals::L1D;
 
+  sim->predictors.report(std::cout);
+  delete sim;
   return 0;
 }
 
@@ -83,6 +83,9 @@ public:
     entry *ptr = tail;
     ptr->unlink();
     tail = ptr->prev;
+    if(tail == nullptr) {
+      head = nullptr;
+    }
     free(ptr);
     cnt--;
   }
@@ -19,6 +19,12 @@
 #include "sim_bitvec.hh"
 #include "branch_predictor.hh"
 #include "simCache.hh"
+#include "blockCache.hh"
+#include "jitMips.hh"
+#include "branchTrace.hh"
+#include "branchTargetBuffer.hh"
+#include "returnStack.hh"
+#include "simulation.hh"
 
 enum class fpOperation {
   abs,neg,mov,add,
@@ -33,8 +39,6 @@ enum class branch_type {
   bc1f, bc1t, bc1fl, bc1tl
 };
 
-static timeval32_t myTimeVal = {0,0};
-static uint32_t myTime = 1<<20;
 
 void execRType(uint32_t inst, state_t *s);
 void execJType(uint32_t inst, state_t *s);
@@ -44,13 +48,34 @@ void execSpecial3(uint32_t inst, state_t *s);
 void execCoproc0(uint32_t inst, state_t *s);
 void execCoproc2(uint32_t inst, state_t *s);
 
-template <bool EL> void execMips(state_t *s);
+/* labels-as-values threaded dispatch needs gcc or clang; build
+ * with -DNO_THREADED_DISPATCH to leave only the switch engine */
+#if defined(__GNUC__) && !defined(NO_THREADED_DISPATCH)
+#define HAVE_THREADED_DISPATCH
+#endif
+
+template <bool EL, bool THREADED> uint64_t execMipsN(state_t *s, uint64_t budget);
 
-void execMipsEL(state_t *s) {
-  execMips<true>(s);
+bool haveThreadedDispatch() {
+#ifdef HAVE_THREADED_DISPATCH
+  return true;
+#else
+  return false;
+#endif
 }
-void execMips(state_t *s) {
-  execMips<false>(s);
+
+uint64_t execMipsN(simulation *sim, uint64_t budget) {
+  state_t *s = sim->state;
+  if(sim->isMipsEL) {
+    if(globals::threadedDispatch) {
+      return execMipsN<true,true>(s, budget);
+    }
+    return execMipsN<true,false>(s, budget);
+  }
+  if(globals::threadedDispatch) {
+    return execMipsN<false,true>(s, budget);
+  }
+  return execMipsN<false,false>(s, budget);
 }
 
 std::ostream &operator<<(std::ostream &out, const state_t & s) {
@@ -89,14 +114,9 @@ static uint32_t getConditionCode(state_t *s, uint32_t cc);
 static void setConditionCode(state_t *s, uint32_t v, uint32_t cc);
 
 
-/* IType instructions */
-static void _sb(uint32_t inst, state_t *s);
-
-
 static void _mtc1(uint32_t inst, state_t *s);
 static void _mfc1(uint32_t inst, state_t *s);
 
-static void _sc(uint32_t inst, state_t *s);
 
 /* FLOATING-POINT */
 static void _c(uint32_t inst, state_t *s);
@@ -148,7 +168,7 @@ void mkMonitorVectors(state_t *s) {
       uint32_t insn = (RSVD_INSTRUCTION |
 		       (((loop >> 2) & RSVD_INSTRUCTION_ARG_MASK)
 			<< RSVD_INSTRUCTION_ARG_SHIFT));
-      *(uint32_t*)(s->mem+vaddr) = globals::isMipsEL ?
+      *(uint32_t*)(s->mem+vaddr) = s->sim->isMipsEL ?
 	bswap<true,uint32_t>(insn) :
 	bswap<false,uint32_t>(insn);
   }
@@ -334,17 +354,11 @@ void execCoproc1x(uint32_t inst, state_t *s) {
 
 
 template <bool EL, branch_type bt>
-void branch(uint32_t inst, state_t *s) {
-  uint32_t rt = (inst >> 16) & 31;
-  uint32_t rs = (inst >> 21) & 31;
-  int16_t himm = (int16_t)(inst & ((1<<16) - 1));
-  int32_t imm = ((int32_t)himm) << 2;
-  uint32_t npc = s->pc+4; 
+void branch(const decoded_insn *di, state_t *s) {
+  uint32_t rt = di->rt;
+  uint32_t rs = di->rs;
   bool isLikely = false, takeBranch = false;
 
-  uint64_t idx;
-  bool bp = globals::bpred->predict(s->pc, idx);
-  
   switch(bt)
     {
     case branch_type::beql:
@@ -380,167 +394,106 @@ void branch(uint32_t inst, state_t *s) {
     case branch_type::bc1tl:
       isLikely = true;
     case branch_type::bc1t:
-      takeBranch = getConditionCode(s,((inst>>18)&7))==1;
+      takeBranch = getConditionCode(s,((di->inst>>18)&7))==1;
       break;
     case branch_type::bc1fl:
       isLikely = true;
     case branch_type::bc1f:
-      takeBranch = getConditionCode(s,((inst>>18)&7))==0;
+      takeBranch = getConditionCode(s,((di->inst>>18)&7))==0;
       break;
     default:
       die();
     }
 
-  globals::bhr->shift_left(1);
-  if(takeBranch) {
-    globals::bhr->set_bit(0);
+  s->sim->predictors.branch(s->pc, takeBranch);
+  if(s->sim->btb) {
+    s->sim->btb->access(s->pc, di->imm, takeBranch);
+  }
+  if(s->sim->trace) {
+    s->sim->trace->record(s->pc, di->imm, branch_kind::cond, takeBranch, s->icnt);
   }
-  globals::bpred->update(s->pc, idx, bp, takeBranch);
   
   s->pc += 4;
-  if(isLikely) {
-    if(takeBranch) {
-      execMips<EL>(s);
-      s->pc = (imm+npc);
-    }
-    else {
-      s->pc += 4;
-    }
-  }
-  else {
-    execMips<EL>(s);
-    if(takeBranch){
-      s->pc = (imm+npc);
-    }
+  s->br_target = takeBranch ? di->imm : (s->pc + 4);
+  if(isLikely and not(takeBranch)) {
+    /* annul the delay slot */
+    s->pc += 4;
   }
 }
 
-template <bool EL>
-void _bgez_bltz(uint32_t inst, state_t *s) {
-  uint32_t rt = (inst >> 16) & 31;
-  switch(rt&3)
-    {
-    case 0:
-      branch<EL,branch_type::bltz>(inst, s);
-      break;
-    case 1:
-      branch<EL,branch_type::bgez>(inst, s);
-      break;
-    case 2:
-      branch<EL,branch_type::bltzl>(inst, s);
-      break;
-    case 3:
-      branch<EL,branch_type::bgezl>(inst, s);
-      break;
-    }
-}
-
 template <typename T, bool EL>
 T load(uint32_t ea, state_t *s) {
-  globals::L1D->read(ea,sizeof(T));
+  s->sim->L1D->read(ea,sizeof(T));
   return bswap<EL>(*reinterpret_cast<T*>(s->mem+ea));
 }
 
 
 template <bool EL>
-void _lw(uint32_t inst, state_t *s) {
-  uint32_t rt = (inst >> 16) & 31;
-  uint32_t rs = (inst >> 21) & 31;
-  int16_t himm = (int16_t)(inst & ((1<<16) - 1));
-  int32_t imm = (int32_t)himm;
-  s->gpr[rt] = load<int32_t,EL>(s->gpr[rs] + imm,s);
+void op_lw(const decoded_insn *di, state_t *s) {
+  s->gpr[di->rt] = load<int32_t,EL>(s->gpr[di->rs] + di->imm,s);
   s->pc += 4;
 }
 
 template <bool EL>
-void _lh(uint32_t inst, state_t *s) {
-  uint32_t rt = (inst >> 16) & 31;
-  uint32_t rs = (inst >> 21) & 31;
-  int16_t himm = (int16_t)(inst & ((1<<16) - 1));
-  int32_t imm = (int32_t)himm;
-  s->gpr[rt] = static_cast<int32_t>(load<int16_t,EL>(s->gpr[rs] + imm,s));
+void op_lh(const decoded_insn *di, state_t *s) {
+  s->gpr[di->rt] = static_cast<int32_t>(load<int16_t,EL>(s->gpr[di->rs] + di->imm,s));
   s->pc +=4;
 }
 
 
 template <bool EL>
-void _lb(uint32_t inst, state_t *s){
-  uint32_t rt = (inst >> 16) & 31;
-  uint32_t rs = (inst >> 21) & 31;
-  int16_t himm = (int16_t)(inst & ((1<<16) - 1));
-  int32_t imm = (int32_t)himm;
-  s->gpr[rt] = static_cast<int32_t>(load<int8_t,EL>(s->gpr[rs] + imm,s));
+void op_lb(const decoded_insn *di, state_t *s){
+  s->gpr[di->rt] = static_cast<int32_t>(load<int8_t,EL>(s->gpr[di->rs] + di->imm,s));
   s->pc += 4;
 }
 
 template <bool EL>
-void _lbu(uint32_t inst, state_t *s) {
-  uint32_t rt = (inst >> 16) & 31;
-  uint32_t rs = (inst >> 21) & 31;
-  int16_t himm = (int16_t)(inst & ((1<<16) - 1));
-  int32_t imm = (int32_t)himm;
-
-  uint32_t ea = s->gpr[rs] + imm;
-  uint32_t zExt = (uint32_t)load<int8_t,EL>(s->gpr[rs] + imm,s);
-  *((uint32_t*)&(s->gpr[rt])) = zExt;
+void op_lbu(const decoded_insn *di, state_t *s) {
+  uint32_t zExt = (uint32_t)load<int8_t,EL>(s->gpr[di->rs] + di->imm,s);
+  *((uint32_t*)&(s->gpr[di->rt])) = zExt;
   s->pc += 4;
 }
 
 template <bool EL>
-void _lhu(uint32_t inst, state_t *s) {
-  uint32_t rt = (inst >> 16) & 31;
-  uint32_t rs = (inst >> 21) & 31;
-  int16_t himm = (int16_t)(inst & ((1<<16) - 1));
-  int32_t imm = (int32_t)himm;
-  
-  uint32_t ea = s->gpr[rs] + imm;
-  uint32_t zExt = (uint32_t)load<int16_t,EL>(s->gpr[rs] + imm,s);
-  *((uint32_t*)&(s->gpr[rt])) = zExt;
+void op_lhu(const decoded_insn *di, state_t *s) {
+  uint32_t zExt = (uint32_t)load<int16_t,EL>(s->gpr[di->rs] + di->imm,s);
+  *((uint32_t*)&(s->gpr[di->rt])) = zExt;
   s->pc += 4;
 }
 
 
 template <bool EL>
-void _sw(uint32_t inst, state_t *s) {
-  uint32_t rt = (inst >> 16) & 31;
-  uint32_t rs = (inst >> 21) & 31;
-  int16_t himm = (int16_t)(inst & ((1<<16) - 1));
-  int32_t imm = (int32_t)himm;
-  uint32_t ea = s->gpr[rs] + imm;
-  globals::L1D->write(ea,4);    
-  *((int32_t*)(s->mem + ea)) = bswap<EL>(s->gpr[rt]);
+void op_sw(const decoded_insn *di, state_t *s) {
+  uint32_t ea = s->gpr[di->rs] + di->imm;
+  s->sim->L1D->write(ea,4);
+  s->sim->bcache.check_store(ea,4);
+  *((int32_t*)(s->mem + ea)) = bswap<EL>(s->gpr[di->rt]);
   
   s->pc += 4;
 }
 
 template <bool EL>
-void _sc(uint32_t inst, state_t *s) {
-  uint32_t rt = (inst >> 16) & 31;
-  _sw<EL>(inst, s);
-  s->gpr[rt] = 1;
+void op_sc(const decoded_insn *di, state_t *s) {
+  op_sw<EL>(di, s);
+  s->gpr[di->rt] = 1;
 }
 
 
 template <bool EL>
-void _sh(uint32_t inst, state_t *s) {
-  uint32_t rt = (inst >> 16) & 31;
-  uint32_t rs = (inst >> 21) & 31;
-  int16_t himm = (int16_t)(inst & ((1<<16) - 1));
-  int32_t imm = (int32_t)himm;
-  uint32_t ea = s->gpr[rs] + imm;
-  globals::L1D->write(ea,2);    
-  *((int16_t*)(s->mem + ea)) = bswap<EL>(((int16_t)s->gpr[rt]));
+void op_sh(const decoded_insn *di, state_t *s) {
+  uint32_t ea = s->gpr[di->rs] + di->imm;
+  s->sim->L1D->write(ea,2);
+  s->sim->bcache.check_store(ea,2);
+  *((int16_t*)(s->mem + ea)) = bswap<EL>(((int16_t)s->gpr[di->rt]));
   s->pc += 4;
 }
 
-static void _sb(uint32_t inst, state_t *s) {
-  uint32_t rt = (inst >> 16) & 31;
-  uint32_t rs = (inst >> 21) & 31;
-  int16_t himm = (int16_t)(inst & ((1<<16) - 1));
-  int32_t imm = (int32_t)himm;
-  uint32_t ea = s->gpr[rs] + imm;
-  globals::L1D->write(ea,1);      
-  s->mem[ea] = (uint8_t)s->gpr[rt];
+template <bool EL>
+void op_sb(const decoded_insn *di, state_t *s) {
+  uint32_t ea = s->gpr[di->rs] + di->imm;
+  s->sim->L1D->write(ea,1);
+  s->sim->bcache.check_store(ea,1);
+  s->mem[ea] = (uint8_t)s->gpr[di->rt];
   s->pc +=4;
 }
 
@@ -560,67 +513,55 @@ static void _mfc1(uint32_t inst, state_t *s) {
 
 
 template <bool EL>
-void _swl(uint32_t inst, state_t *s) {
-  uint32_t rt = (inst >> 16) & 31;
-  uint32_t rs = (inst >> 21) & 31;
-  int16_t himm = (int16_t)(inst & ((1<<16) - 1));
-  int32_t imm = (int32_t)himm;
-
-  uint32_t ea = s->gpr[rs] + imm;
+void op_swl(const decoded_insn *di, state_t *s) {
+  uint32_t ea = s->gpr[di->rs] + di->imm;
   uint32_t ma = ea & 3;
   ea &= 0xfffffffc;
   if(EL)
     ma = 3 - ma;
   uint32_t r = bswap<EL>(*((int32_t*)(s->mem + ea))); 
-  uint32_t xx=0,x = s->gpr[rt];
+  uint32_t xx=0,x = s->gpr[di->rt];
   
   uint32_t xs = x >> (8*ma);
   uint32_t m = ~((1U << (8*(4 - ma))) - 1);
   xx = (r & m) | xs;
   *((uint32_t*)(s->mem + ea)) = bswap<EL>(xx);
-  globals::L1D->write(ea,4);  
+  s->sim->L1D->write(ea,4);
+  s->sim->bcache.check_store(ea,4);
   s->pc += 4;
 }
 
 template <bool EL>
-void _swr(uint32_t inst, state_t *s) {
-  uint32_t rt = (inst >> 16) & 31;
-  uint32_t rs = (inst >> 21) & 31;
-  int16_t himm = (int16_t)(inst & ((1<<16) - 1));
-  int32_t imm = (int32_t)himm;
-   
-  uint32_t ea = s->gpr[rs] + imm;
+void op_swr(const decoded_insn *di, state_t *s) {
+  uint32_t ea = s->gpr[di->rs] + di->imm;
   uint32_t ma = ea & 3;
   if(EL)
     ma = 3 - ma;
   ea &= 0xfffffffc;
   uint32_t r = bswap<EL>(*((int32_t*)(s->mem + ea))); 
-  uint32_t xx=0,x = s->gpr[rt];
+  uint32_t xx=0,x = s->gpr[di->rt];
   
   uint32_t xs = 8*(3-ma);
   uint32_t rm = (1U << xs) - 1;
 
   xx = (x << xs) | (rm & r);
   *((uint32_t*)(s->mem + ea)) = bswap<EL>(xx);
-  globals::L1D->write(ea,4);
+  s->sim->L1D->write(ea,4);
+  s->sim->bcache.check_store(ea,4);
   s->pc += 4;
 }
 
 template <bool EL>
-void _lwl(uint32_t inst, state_t *s) {
-  uint32_t rt = (inst >> 16) & 31;
-  uint32_t rs = (inst >> 21) & 31;
-  int16_t himm = (int16_t)(inst & ((1<<16) - 1));
-  int32_t imm = (int32_t)himm;
-  
-  uint32_t ea = ((uint32_t)s->gpr[rs] + imm);
+void op_lwl(const decoded_insn *di, state_t *s) {
+  uint32_t rt = di->rt;
+  uint32_t ea = ((uint32_t)s->gpr[di->rs] + di->imm);
   uint32_t ma = ea & 3;
   ea &= 0xfffffffc;
   if(EL)
     ma = 3 - ma;
   int32_t r = bswap<EL>(*((int32_t*)(s->mem + ea))); 
   int32_t x =  s->gpr[rt];
-  globals::L1D->read(ea,4);
+  s->sim->L1D->read(ea,4);
   
   switch(ma)
     {
@@ -641,16 +582,12 @@ void _lwl(uint32_t inst, state_t *s) {
 }
 
 template<bool EL>
-void _lwr(uint32_t inst, state_t *s) {
-  uint32_t rt = (inst >> 16) & 31;
-  uint32_t rs = (inst >> 21) & 31;
-  int16_t himm = (int16_t)(inst & ((1<<16) - 1));
-  int32_t imm = (int32_t)himm;
- 
-  uint32_t ea = ((uint32_t)s->gpr[rs] + imm);
+void op_lwr(const decoded_insn *di, state_t *s) {
+  uint32_t rt = di->rt;
+  uint32_t ea = ((uint32_t)s->gpr[di->rs] + di->imm);
   uint32_t ma = ea & 3;
   ea &= 0xfffffffc;
-  globals::L1D->read(ea,4);
+  s->sim->L1D->read(ea,4);
   
   if(EL)
     ma = 3-ma;
@@ -687,7 +624,7 @@ void _monitorBody(uint32_t inst, state_t *s) {
   tms32_t tms32_buf;
   struct stat native_stat;
   stat32_t *host_stat = nullptr;
-  globals::L1D->flush();
+  s->sim->L1D->flush();
   switch(reason)
     {
     case 6: /* int open(char *path, int flags) */
@@ -748,11 +685,11 @@ void _monitorBody(uint32_t inst, state_t *s) {
 	tp32.tv_usec = bswap<EL>((uint32_t)tp.tv_usec);
       }
       else {
-	memcpy(&tp32, &myTimeVal, sizeof(tp32));
-	myTimeVal.tv_usec++;
-	if(myTimeVal.tv_usec == (1<<20)) {
-	  myTimeVal.tv_usec = 0;
-	  myTimeVal.tv_sec++;
+	memcpy(&tp32, &s->sim->myTimeVal, sizeof(tp32));
+	s->sim->myTimeVal.tv_usec++;
+	if(s->sim->myTimeVal.tv_usec == (1<<20)) {
+	  s->sim->myTimeVal.tv_usec = 0;
+	  s->sim->myTimeVal.tv_sec++;
 	}
       }
       *((timeval32_t*)(s->mem + (uint32_t)s->gpr[R_a0] + 0)) = tp32;
@@ -766,20 +703,20 @@ void _monitorBody(uint32_t inst, state_t *s) {
 	tms32_buf.tms_cutime = bswap<EL>((uint32_t)tms_buf.tms_cutime);
 	tms32_buf.tms_cstime = bswap<EL>((uint32_t)tms_buf.tms_cstime);
       } else {
-	*((uint32_t*)(&s->gpr[R_v0])) = myTime;
-	myTime += 100;
+	*((uint32_t*)(&s->gpr[R_v0])) = s->sim->myTime;
+	s->sim->myTime += 100;
 	memset(&tms32_buf, 0, sizeof(tms32_buf));
       }
       *((tms32_t*)(s->mem + (uint32_t)s->gpr[R_a0] + 0)) = tms32_buf;
       break;
     case 35:
       /* int getargs(char **argv) */
-      for(int i = 0; i < std::min(MARGS, globals::sysArgc); i++) {
+      for(int i = 0; i < std::min(MARGS, s->sim->sysArgc); i++) {
 	  uint32_t arrayAddr = ((uint32_t)s->gpr[R_a0])+4*i;
 	  uint32_t ptr = bswap<EL>(*((uint32_t*)(s->mem + arrayAddr)));
-	  strcpy((char*)(s->mem + ptr), globals::sysArgv[i]);
+	  strcpy((char*)(s->mem + ptr), s->sim->sysArgv[i]);
 	}
-      s->gpr[R_v0] = globals::sysArgc;
+      s->gpr[R_v0] = s->sim->sysArgc;
       break;
     case 37:
       /*char *getcwd(char *buf, uint32_t size) */
@@ -817,51 +754,37 @@ void _monitorBody(uint32_t inst, state_t *s) {
 
 
 template <bool EL>
-void _ldc1(uint32_t inst, state_t *s) {
-  uint32_t ft = (inst >> 16) & 31;
-  uint32_t rs = (inst >> 21) & 31;
-  int16_t himm = (int16_t)(inst & ((1<<16) - 1));
-  int32_t imm = (int32_t)himm;
-  uint32_t ea = s->gpr[rs] + imm;
-  globals::L1D->read(ea,8);    
-  *((int64_t*)(s->cpr1 + ft)) = bswap<EL>(*((int64_t*)(s->mem + ea))); 
+void op_ldc1(const decoded_insn *di, state_t *s) {
+  uint32_t ea = s->gpr[di->rs] + di->imm;
+  s->sim->L1D->read(ea,8);    
+  *((int64_t*)(s->cpr1 + di->rt)) = bswap<EL>(*((int64_t*)(s->mem + ea))); 
   s->pc += 4;
 }
 
 template <bool EL>
-void _sdc1(uint32_t inst, state_t *s) {
-  uint32_t ft = (inst >> 16) & 31;
-  uint32_t rs = (inst >> 21) & 31;
-  int16_t himm = (int16_t)(inst & ((1<<16) - 1));
-  int32_t imm = (int32_t)himm;
-  uint32_t ea = s->gpr[rs] + imm;
-  globals::L1D->write(ea,8);    
-  *((int64_t*)(s->mem + ea)) = bswap<EL>((*(int64_t*)(s->cpr1 + ft)));
+void op_sdc1(const decoded_insn *di, state_t *s) {
+  uint32_t ea = s->gpr[di->rs] + di->imm;
+  s->sim->L1D->write(ea,8);
+  s->sim->bcache.check_store(ea,8);
+  *((int64_t*)(s->mem + ea)) = bswap<EL>((*(int64_t*)(s->cpr1 + di->rt)));
   s->pc += 4;
 }
 
 template <bool EL>
-void _lwc1(uint32_t inst, state_t *s) {
-  uint32_t ft = (inst >> 16) & 31;
-  uint32_t rs = (inst >> 21) & 31;
-  int16_t himm = (int16_t)(inst & ((1<<16) - 1));
-  int32_t imm = (int32_t)himm;
-  uint32_t ea = s->gpr[rs] + imm;
+void op_lwc1(const decoded_insn *di, state_t *s) {
+  uint32_t ea = s->gpr[di->rs] + di->imm;
   uint32_t v = bswap<EL>(*((uint32_t*)(s->mem + ea)));
-  globals::L1D->read(ea,4);  
-  *((float*)(s->cpr1 + ft)) = *((float*)&v);
+  s->sim->L1D->read(ea,4);  
+  *((float*)(s->cpr1 + di->rt)) = *((float*)&v);
   s->pc += 4;
 }
 
 template <bool EL>
-void _swc1(uint32_t inst, state_t *s) {
-  uint32_t ft = (inst >> 16) & 31;
-  uint32_t rs = (inst >> 21) & 31;
-  int16_t himm = (int16_t)(inst & ((1<<16) - 1));
-  int32_t imm = (int32_t)himm;
-  uint32_t ea = s->gpr[rs] + imm;
-  globals::L1D->write(ea,4);  
-  uint32_t v = *((uint32_t*)(s->cpr1+ft));
+void op_swc1(const decoded_insn *di, state_t *s) {
+  uint32_t ea = s->gpr[di->rs] + di->imm;
+  s->sim->L1D->write(ea,4);
+  s->sim->bcache.check_store(ea,4);
+  uint32_t v = *((uint32_t*)(s->cpr1+di->rt));
   *((uint32_t*)(s->mem + ea)) = bswap<EL>(v);
   s->pc += 4;
 }
@@ -1208,32 +1131,12 @@ void execCoproc1(uint32_t inst, state_t *s) {
   uint32_t opcode = inst>>26;
   uint32_t functField = (inst>>21) & 31;
   uint32_t lowop = inst & 63;  
-  uint32_t fmt = (inst >> 21) & 31;
-  uint32_t nd_tf = (inst>>16) & 3;
   
   uint32_t lowbits = inst & ((1<<11)-1);
   opcode &= 0x3;
 
-  if(fmt == 0x8)
-    {
-      switch(nd_tf)
-	{
-	case 0x0:
-	  branch<EL,branch_type::bc1f>(inst, s);
-	  break;
-	case 0x1:
-	  branch<EL,branch_type::bc1t>(inst, s);
-	  break;
-	case 0x2:
-	  branch<EL,branch_type::bc1fl>(inst, s);
-	  break;
-	case 0x3:
-	  branch<EL,branch_type::bc1tl>(inst, s);
-	  break;
-	}
-      /*BRANCH*/
-    }
-  else if((lowbits == 0) && ((functField==0x0) || (functField==0x4)))
+  /* bc1 branches (fmt == 0x8) are split out by the predecoder */
+  if((lowbits == 0) && ((functField==0x0) || (functField==0x4)))
     {
       if(functField == 0x0)
 	{
@@ -1317,407 +1220,762 @@ void execCoproc1(uint32_t inst, state_t *s) {
     }
 }
 
+#define BRANCH_OP(X)							\
+  template <bool EL>							\
+  static void op_##X(const decoded_insn *di, state_t *s) {		\
+    branch<EL,branch_type::X>(di, s);					\
+  }
+BRANCH_OP(beq)
+BRANCH_OP(bne)
+BRANCH_OP(blez)
+BRANCH_OP(bgtz)
+BRANCH_OP(beql)
+BRANCH_OP(bnel)
+BRANCH_OP(blezl)
+BRANCH_OP(bgtzl)
+BRANCH_OP(bgez)
+BRANCH_OP(bgezl)
+BRANCH_OP(bltz)
+BRANCH_OP(bltzl)
+BRANCH_OP(bc1f)
+BRANCH_OP(bc1t)
+BRANCH_OP(bc1fl)
+BRANCH_OP(bc1tl)
+#undef BRANCH_OP
+
+template <bool EL>
+static void op_sll(const decoded_insn *di, state_t *s) {
+  s->gpr[di->rd] = s->gpr[di->rt] << di->sa;
+  s->pc += 4;
+}
+
+template <bool EL>
+static void op_srl(const decoded_insn *di, state_t *s) {
+  s->gpr[di->rd] = ((uint32_t)s->gpr[di->rt] >> di->sa);
+  s->pc += 4;
+}
+
+template <bool EL>
+static void op_sra(const decoded_insn *di, state_t *s) {
+  s->gpr[di->rd] = s->gpr[di->rt] >> di->sa;
+  s->pc += 4;
+}
+
+template <bool EL>
+static void op_sllv(const decoded_insn *di, state_t *s) {
+  s->gpr[di->rd] = s->gpr[di->rt] << (s->gpr[di->rs] & 0x1f);
+  s->pc += 4;
+}
+
+template <bool EL>
+static void op_srlv(const decoded_insn *di, state_t *s) {
+  s->gpr[di->rd] = ((uint32_t)s->gpr[di->rt]) >> (s->gpr[di->rs] & 0x1f);
+  s->pc += 4;
+}
+
+template <bool EL>
+static void op_srav(const decoded_insn *di, state_t *s) {
+  s->gpr[di->rd] = s->gpr[di->rt] >> (s->gpr[di->rs] & 0x1f);
+  s->pc += 4;
+}
+
+template <bool EL>
+static void op_movci(const decoded_insn *di, state_t *s) {
+  _movci(di->inst, s);
+}
+
+template <bool EL>
+static void op_monitor(const decoded_insn *di, state_t *s) {
+  _monitorBody<EL>(di->inst, s);
+}
+
+template <bool EL>
+static void op_jr(const decoded_insn *di, state_t *s) {
+  uint32_t jaddr = s->gpr[di->rs];
+  if(s->sim->btb) {
+    s->sim->btb->access(s->pc, jaddr, true, false);
+  }
+  if(s->sim->trace) {
+    s->sim->trace->record(s->pc, jaddr, (di->rs == 31) ? branch_kind::ret :
+			   branch_kind::indirect, true, s->icnt);
+  }
+  s->pc += 4;
+  if(di->rs == 31) {
+    if(not(s->sim->rsb->pop(jaddr))) {
+      s->sim->bpred->getMap()[s->pc-4]++;
+    }
+  }
+  else {
+    s->sim->predictors.indirect_jump(s->pc-4, jaddr);
+  }
+  s->sim->predictors.jump();
+  s->br_target = jaddr;
+}
+
+template <bool EL>
+static void op_jalr(const decoded_insn *di, state_t *s) {
+  uint32_t jaddr = s->gpr[di->rs];
+  if(s->sim->btb) {
+    s->sim->btb->access(s->pc, jaddr, true, false);
+  }
+  if(s->sim->trace) {
+    s->sim->trace->record(s->pc, jaddr, branch_kind::icall, true, s->icnt);
+  }
+  s->sim->predictors.indirect_jump(s->pc, jaddr);
+  s->gpr[31] = s->pc+8;
+  s->sim->rsb->push(s->gpr[31]);
+  s->pc += 4;
+  s->sim->predictors.jump();
+  s->br_target = jaddr;
+}
+
+template <bool EL>
+static void op_syscall(const decoded_insn *di, state_t *s) {
+  printf("syscall()\n");
+  std::cerr << "mem crc32=" << std::hex
+	    << crc32(s->mem, 1UL<<32)<<std::dec
+	    << "\n";
+  std::cerr << "gpr crc32=" << std::hex
+	    << crc32(reinterpret_cast<uint8_t*>(&s->gpr), 4*32)<<std::dec
+	    << "\n";
+  for(int i  = 0; i < 32; i++) {
+    std::cerr << "gpr[" << i << "] = " << std::hex << s->gpr[i] << std::dec << "\n";
+  }
+  exit(-1);
+}
+
+template <bool EL>
+static void op_break_(const decoded_insn *di, state_t *s) {
+  s->brk = 1;
+}
+
+template <bool EL>
+static void op_sync(const decoded_insn *di, state_t *s) {
+  s->pc += 4;
+}
+
+template <bool EL>
+static void op_mfhi(const decoded_insn *di, state_t *s) {
+  s->gpr[di->rd] = s->hi;
+  s->pc += 4;
+}
+
+template <bool EL>
+static void op_mthi(const decoded_insn *di, state_t *s) {
+  s->hi = s->gpr[di->rs];
+  s->pc += 4;
+}
+
+template <bool EL>
+static void op_mflo(const decoded_insn *di, state_t *s) {
+  s->gpr[di->rd] = s->lo;
+  s->pc += 4;
+}
+
+template <bool EL>
+static void op_mtlo(const decoded_insn *di, state_t *s) {
+  s->lo = s->gpr[di->rs];
+  s->pc += 4;
+}
+
+template <bool EL>
+static void op_mult(const decoded_insn *di, state_t *s) {
+  int64_t y;
+  y = (int64_t)s->gpr[di->rs] * (int64_t)s->gpr[di->rt];
+  s->lo = (int32_t)(y & 0xffffffff);
+  s->hi = (int32_t)(y >> 32);
+  s->pc += 4;
+}
+
+template <bool EL>
+static void op_multu(const decoded_insn *di, state_t *s) {
+  uint64_t y;
+  uint64_t u0 = (uint64_t)*((uint32_t*)&s->gpr[di->rs]);
+  uint64_t u1 = (uint64_t)*((uint32_t*)&s->gpr[di->rt]);
+  y = u0*u1;
+  *((uint32_t*)&(s->lo)) = (uint32_t)y;
+  *((uint32_t*)&(s->hi)) = (uint32_t)(y>>32);
+  s->pc += 4;
+}
+
+template <bool EL>
+static void op_div(const decoded_insn *di, state_t *s) {
+  if(s->gpr[di->rt] != 0) {
+    s->lo = s->gpr[di->rs] / s->gpr[di->rt];
+    s->hi = s->gpr[di->rs] % s->gpr[di->rt];
+  }
+  s->pc += 4;
+}
+
+template <bool EL>
+static void op_divu(const decoded_insn *di, state_t *s) {
+  if(s->gpr[di->rt] != 0) {
+    s->lo = (uint32_t)s->gpr[di->rs] / (uint32_t)s->gpr[di->rt];
+    s->hi = (uint32_t)s->gpr[di->rs] % (uint32_t)s->gpr[di->rt];
+  }
+  s->pc += 4;
+}
+
+template <bool EL>
+static void op_add(const decoded_insn *di, state_t *s) {
+  s->gpr[di->rd] = s->gpr[di->rs] + s->gpr[di->rt];
+  s->pc += 4;
+}
+
+template <bool EL>
+static void op_addu(const decoded_insn *di, state_t *s) {
+  uint32_t u_rs = (uint32_t)s->gpr[di->rs];
+  uint32_t u_rt = (uint32_t)s->gpr[di->rt];
+  s->gpr[di->rd] = u_rs + u_rt;
+  s->pc += 4;
+}
+
+template <bool EL>
+static void op_sub(const decoded_insn *di, state_t *s) {
+  printf("sub()\n");
+  exit(-1);
+}
+
+template <bool EL>
+static void op_subu(const decoded_insn *di, state_t *s) {
+  uint32_t u_rs = (uint32_t)s->gpr[di->rs];
+  uint32_t u_rt = (uint32_t)s->gpr[di->rt];
+  s->gpr[di->rd] = u_rs - u_rt;
+  s->pc += 4;
+}
+
 template <bool EL>
-void execMips(state_t *s) {
-  uint8_t *mem = s->mem;
-  uint32_t inst = bswap<EL>(*(uint32_t*)(mem + s->pc));
-  s->last_pc = s->pc;
-  //std::cout << std::hex << s->pc << std::dec << " : " 
-  //<< getAsmString(inst, s->pc) << "\n";
+static void op_and_(const decoded_insn *di, state_t *s) {
+  s->gpr[di->rd] = s->gpr[di->rs] & s->gpr[di->rt];
+  s->pc += 4;
+}
+
+template <bool EL>
+static void op_or_(const decoded_insn *di, state_t *s) {
+  s->gpr[di->rd] = s->gpr[di->rs] | s->gpr[di->rt];
+  s->pc += 4;
+}
 
-  //std::cout << std::hex << s->pc << std::dec << " : "
-  //<< getAsmString(inst, s->pc) << "\n";
+template <bool EL>
+static void op_xor_(const decoded_insn *di, state_t *s) {
+  s->gpr[di->rd] = s->gpr[di->rs] ^ s->gpr[di->rt];
+  s->pc += 4;
+}
+
+template <bool EL>
+static void op_nor(const decoded_insn *di, state_t *s) {
+  s->gpr[di->rd] = ~(s->gpr[di->rs] | s->gpr[di->rt]);
+  s->pc += 4;
+}
+
+template <bool EL>
+static void op_slt(const decoded_insn *di, state_t *s) {
+  s->gpr[di->rd] = s->gpr[di->rs] < s->gpr[di->rt];
+  s->pc += 4;
+}
+
+template <bool EL>
+static void op_sltu(const decoded_insn *di, state_t *s) {
+  uint32_t urs = (uint32_t)s->gpr[di->rs];
+  uint32_t urt = (uint32_t)s->gpr[di->rt];
+  s->gpr[di->rd] = (urs < urt);
+  s->pc += 4;
+}
+
+template <bool EL>
+static void op_movn(const decoded_insn *di, state_t *s) {
+  s->gpr[di->rd] = (s->gpr[di->rt] != 0) ? s->gpr[di->rs] : s->gpr[di->rd];
+  s->pc +=4;
+}
+
+template <bool EL>
+static void op_movz(const decoded_insn *di, state_t *s) {
+  s->gpr[di->rd] = (s->gpr[di->rt] == 0) ? s->gpr[di->rs] : s->gpr[di->rd];
+  s->pc += 4;
+}
+
+template <bool EL>
+static void op_teq(const decoded_insn *di, state_t *s) {
+  if(s->gpr[di->rs] == s->gpr[di->rt]) {
+    printf("teq trap!!!!!\n");
+    exit(-1);
+  }
+  s->pc += 4;
+}
+
+template <bool EL>
+static void op_rtype_unknown(const decoded_insn *di, state_t *s) {
+  printf("%sunknown RType instruction %x, funct = %d%s\n", 
+	 KRED, s->pc, di->inst & 63, KNRM);
+  exit(-1);
+}
+
+template <bool EL>
+static void op_special2(const decoded_insn *di, state_t *s) {
+  execSpecial2(di->inst, s);
+}
+
+template <bool EL>
+static void op_special3(const decoded_insn *di, state_t *s) {
+  execSpecial3(di->inst, s);
+}
+
+static inline void jump(const decoded_insn *di, state_t *s, branch_kind k) {
+  if(s->sim->btb) {
+    s->sim->btb->access(s->pc, di->imm, true);
+  }
+  if(s->sim->trace) {
+    s->sim->trace->record(s->pc, di->imm, k, true, s->icnt);
+  }
+  s->pc += 4;
+  s->sim->predictors.jump();
+  s->br_target = di->imm;
+}
+
+template <bool EL>
+static void op_j(const decoded_insn *di, state_t *s) {
+  jump(di, s, branch_kind::jump);
+}
+
+template <bool EL>
+static void op_jal(const decoded_insn *di, state_t *s) {
+  s->gpr[31] = s->pc+8;
+  s->sim->rsb->push(s->gpr[31]);
+  jump(di, s, branch_kind::call);
+}
+
+template <bool EL>
+static void op_coproc0(const decoded_insn *di, state_t *s) {
+  switch(di->rs) 
+    {
+    case 0x0: /*mfc0*/
+      s->gpr[di->rt] = s->cpr0[di->rd];
+      break;
+    case 0x4: /*mtc0*/
+      s->cpr0[di->rd] = s->gpr[di->rt];
+      break;
+    default:
+      printf("unknown %s instruction @ %x", __func__, s->pc); exit(-1);
+      break;
+    }
+  s->pc += 4;
+}
+
+template <bool EL>
+static void op_coproc1(const decoded_insn *di, state_t *s) {
+  execCoproc1<EL>(di->inst, s);
+}
+
+template <bool EL>
+static void op_coproc1x(const decoded_insn *di, state_t *s) {
+  execCoproc1x<EL>(di->inst, s);
+}
+
+template <bool EL>
+static void op_coproc2(const decoded_insn *di, state_t *s) {
+  printf("coproc2 unimplemented\n");  exit(-1);
+}
+
+template <bool EL>
+static void op_addiu(const decoded_insn *di, state_t *s) {
+  s->gpr[di->rt] = s->gpr[di->rs] + di->imm;  
+  s->pc+=4;
+}
+
+template <bool EL>
+static void op_slti(const decoded_insn *di, state_t *s) {
+  s->gpr[di->rt] = (s->gpr[di->rs] < di->imm);
+  s->pc += 4;
+}
+
+template <bool EL>
+static void op_sltiu(const decoded_insn *di, state_t *s) {
+  s->gpr[di->rt] = ((uint32_t)s->gpr[di->rs] < (uint32_t)di->imm);
+  s->pc += 4;
+}
+
+template <bool EL>
+static void op_andi(const decoded_insn *di, state_t *s) {
+  s->gpr[di->rt] = s->gpr[di->rs] & di->imm;
+  s->pc += 4;
+}
+
+template <bool EL>
+static void op_ori(const decoded_insn *di, state_t *s) {
+  s->gpr[di->rt] = s->gpr[di->rs] | di->imm;
+  s->pc += 4;
+}
+
+template <bool EL>
+static void op_xori(const decoded_insn *di, state_t *s) {
+  s->gpr[di->rt] = s->gpr[di->rs] ^ di->imm;
+  s->pc += 4;
+}
+
+template <bool EL>
+static void op_lui(const decoded_insn *di, state_t *s) {
+  s->gpr[di->rt] = di->imm;
+  s->pc += 4;
+}
+
+template <bool EL>
+static void op_itype_unknown(const decoded_insn *di, state_t *s) {
+  printf("%s: Unknown IType instruction (bits=%x) @ pc=0x%08x\n", 
+	 __func__, di->inst, s->pc);
+  exit(-1);
+}
+
+template <bool EL>
+static mips_handler getHandler(mips_op op) {
+  static const mips_handler handlers[] = {
+#define ITEM(X,K) &op_##X<EL>,
+    MIPS_OP_LIST(ITEM)
+#undef ITEM
+  };
+  return handlers[static_cast<size_t>(op)];
+}
+
+static mips_op decodeRType(uint32_t inst) {
+  switch(inst & 63)
+    {
+    case 0x00: return mips_op::sll;
+    case 0x01: return mips_op::movci;
+    case 0x02: return mips_op::srl;
+    case 0x03: return mips_op::sra;
+    case 0x04: return mips_op::sllv;
+    case 0x05: return mips_op::monitor;
+    case 0x06: return mips_op::srlv;
+    case 0x07: return mips_op::srav;
+    case 0x08: return mips_op::jr;
+    case 0x09: return mips_op::jalr;
+    case 0x0A: return mips_op::movz;
+    case 0x0B: return mips_op::movn;
+    case 0x0C: return mips_op::syscall;
+    case 0x0D: return mips_op::break_;
+    case 0x0f: return mips_op::sync;
+    case 0x10: return mips_op::mfhi;
+    case 0x11: return mips_op::mthi;
+    case 0x12: return mips_op::mflo;
+    case 0x13: return mips_op::mtlo;
+    case 0x18: return mips_op::mult;
+    case 0x19: return mips_op::multu;
+    case 0x1A: return mips_op::div;
+    case 0x1B: return mips_op::divu;
+    case 0x20: return mips_op::add;
+    case 0x21: return mips_op::addu;
+    case 0x22: return mips_op::sub;
+    case 0x23: return mips_op::subu;
+    case 0x24: return mips_op::and_;
+    case 0x25: return mips_op::or_;
+    case 0x26: return mips_op::xor_;
+    case 0x27: return mips_op::nor;
+    case 0x2A: return mips_op::slt;
+    case 0x2B: return mips_op::sltu;
+    case 0x34: return mips_op::teq;
+    default:
+      break;
+    }
+  return mips_op::rtype_unknown;
+}
+
+static mips_op decodeIType(uint32_t inst) {
   uint32_t opcode = inst>>26;
-  bool isRType = (opcode==0);
-  bool isJType = ((opcode>>1)==1);
-  bool isCoproc0 = (opcode == 0x10);
-  bool isCoproc1 = (opcode == 0x11);
-  bool isCoproc1x = (opcode == 0x13);
-  bool isCoproc2 = (opcode == 0x12);
-  bool isSpecial2 = (opcode == 0x1c); 
-  bool isSpecial3 = (opcode == 0x1f);
-  bool isLoadLinked = (opcode == 0x30);
-  bool isStoreCond = (opcode == 0x38);
-  uint32_t rs = (inst >> 21) & 31;
-  uint32_t rt = (inst >> 16) & 31;
-  uint32_t rd = (inst >> 11) & 31;
-  s->icnt++;
-    
-  if(isRType) {
-    uint32_t funct = inst & 63;
-    uint32_t sa = (inst >> 6) & 31;
-    switch(funct) 
-      {
-      case 0x00: /*sll*/
-	s->gpr[rd] = s->gpr[rt] << sa;
-	s->pc += 4;
-	break;
-      case 0x01: /* movci */
-	_movci(inst,s);
-	break;
-      case 0x02: /* srl */
-	s->gpr[rd] = ((uint32_t)s->gpr[rt] >> sa);
-	s->pc += 4;
-	break;
-      case 0x03: /* sra */
-	s->gpr[rd] = s->gpr[rt] >> sa;
-	s->pc += 4;
-	break;
-      case 0x04: /* sllv */
-	s->gpr[rd] = s->gpr[rt] << (s->gpr[rs] & 0x1f);
-	s->pc += 4;
-	break;
-      case 0x05:
-	_monitorBody<EL>(inst, s);
-	break;
-      case 0x06:  
-	s->gpr[rd] = ((uint32_t)s->gpr[rt]) >> (s->gpr[rs] & 0x1f);
-	s->pc += 4;
-	break;
-      case 0x07:  
-	s->gpr[rd] = s->gpr[rt] >> (s->gpr[rs] & 0x1f);
-	s->pc += 4;
-	break;
-      case 0x08: { /* jr */
-	uint32_t jaddr = s->gpr[rs];
-	s->pc += 4;
-	if(rs == 31) {
-	  globals::rsb_tos = (globals::rsb_tos + 1) & (globals::rsb_sz - 1);
-	  if(jaddr != globals::rsb[globals::rsb_tos]) {
-	    ++globals::num_jr_r31_mispred;
-	    globals::bpred->getMap()[s->pc-4]++;
-	  }
-	  ++globals::num_jr_r31;
-	}
-	globals::bhr->shift_left(1);
-	globals::bhr->set_bit(0);
-	execMips<EL>(s);
-	s->pc = jaddr;
+  switch(opcode) 
+    {
+    case 0x01: {
+      static const mips_op regimm[4] = {
+	mips_op::bltz, mips_op::bgez, mips_op::bltzl, mips_op::bgezl
+      };
+      return regimm[(inst >> 16) & 3];
+    }
+    case 0x04: return mips_op::beq;
+    case 0x05: return mips_op::bne;
+    case 0x06: return mips_op::blez;
+    case 0x07: return mips_op::bgtz;
+      /* addi doesn't trap on overflow here, so it is addiu */
+    case 0x08: return mips_op::addiu;
+    case 0x09: return mips_op::addiu;
+    case 0x0A: return mips_op::slti;
+    case 0x0B: return mips_op::sltiu;
+    case 0x0c: return mips_op::andi;
+    case 0x0d: return mips_op::ori;
+    case 0x0e: return mips_op::xori;
+    case 0x0F: return mips_op::lui;
+    case 0x14: return mips_op::beql;
+    case 0x15: return mips_op::bnel;
+    case 0x16: return mips_op::blezl;
+    case 0x17: return mips_op::bgtzl;
+    case 0x20: return mips_op::lb;
+    case 0x21: return mips_op::lh;
+    case 0x22: return mips_op::lwl;
+    case 0x23: return mips_op::lw;
+    case 0x24: return mips_op::lbu;
+    case 0x25: return mips_op::lhu;
+    case 0x26: return mips_op::lwr;
+    case 0x28: return mips_op::sb;
+    case 0x29: return mips_op::sh;
+    case 0x2a: return mips_op::swl;
+    case 0x2B: return mips_op::sw;
+    case 0x2e: return mips_op::swr;
+    case 0x31: return mips_op::lwc1;
+    case 0x35: return mips_op::ldc1;
+    case 0x39: return mips_op::swc1;
+    case 0x3D: return mips_op::sdc1;
+    default:
+      break;
+    }
+  return mips_op::itype_unknown;
+}
 
-	break;
-      }
-      case 0x09: { /* jalr */
-	uint32_t jaddr = s->gpr[rs];
-	s->gpr[31] = s->pc+8;
-	globals::rsb[globals::rsb_tos] = s->gpr[31];
-	globals::rsb_tos = (globals::rsb_tos - 1) & (globals::rsb_sz - 1);	
-	s->pc += 4;
-	globals::bhr->shift_left(1);
-	globals::bhr->set_bit(0);	
-	execMips<EL>(s);
-	s->pc = jaddr;
-	break;
-      }
-      case 0x0C: /* syscall */
-	printf("syscall()\n");
-	std::cerr << "mem crc32=" << std::hex
-		  << crc32(s->mem, 1UL<<32)<<std::dec
-		  << "\n";
-	std::cerr << "gpr crc32=" << std::hex
-		  << crc32(reinterpret_cast<uint8_t*>(&s->gpr), 4*32)<<std::dec
-		  << "\n";
-	for(int i  = 0; i < 32; i++) {
-	  std::cerr << "gpr[" << i << "] = " << std::hex << s->gpr[i] << std::dec << "\n";
-	}
-	exit(-1);
-	break;
-      case 0x0D: /* break */
-	s->brk = 1;
-	break;
-      case 0x0f: /* sync */
-	s->pc += 4;
-	break;
-      case 0x10: /* mfhi */
-	s->gpr[rd] = s->hi;
-	s->pc += 4;
-	break;
-      case 0x11: /* mthi */ 
-	s->hi = s->gpr[rs];
-	s->pc += 4;
-	break;
-      case 0x12: /* mflo */
-	s->gpr[rd] = s->lo;
-	s->pc += 4;
-	break;
-      case 0x13: /* mtlo */
-	s->lo = s->gpr[rs];
-	s->pc += 4;
-	break;
-      case 0x18: { /* mult */
-	int64_t y;
-	y = (int64_t)s->gpr[rs] * (int64_t)s->gpr[rt];
-	s->lo = (int32_t)(y & 0xffffffff);
-	s->hi = (int32_t)(y >> 32);
-	s->pc += 4;
-	break;
-      }
-      case 0x19: { /* multu */
-	uint64_t y;
-	uint64_t u0 = (uint64_t)*((uint32_t*)&s->gpr[rs]);
-	uint64_t u1 = (uint64_t)*((uint32_t*)&s->gpr[rt]);
-	y = u0*u1;
-	*((uint32_t*)&(s->lo)) = (uint32_t)y;
-	*((uint32_t*)&(s->hi)) = (uint32_t)(y>>32);
-	s->pc += 4;
-	break;
-      }
-      case 0x1A: /* div */
-	if(s->gpr[rt] != 0) {
-	  s->lo = s->gpr[rs] / s->gpr[rt];
-	  s->hi = s->gpr[rs] % s->gpr[rt];
-	}
-	s->pc += 4;
-	break;
-      case 0x1B: /* divu */
-	if(s->gpr[rt] != 0) {
-	  s->lo = (uint32_t)s->gpr[rs] / (uint32_t)s->gpr[rt];
-	  s->hi = (uint32_t)s->gpr[rs] % (uint32_t)s->gpr[rt];
-	}
-	s->pc += 4;
-	break;
-      case 0x20: /* add */
-	s->gpr[rd] = s->gpr[rs] + s->gpr[rt];
-	s->pc += 4;
-	break;
-      case 0x21: { /* addu */
-	uint32_t u_rs = (uint32_t)s->gpr[rs];
-	uint32_t u_rt = (uint32_t)s->gpr[rt];
-	s->gpr[rd] = u_rs + u_rt;
-	s->pc += 4;
-	break;
+static mips_op decodeOp(uint32_t inst) {
+  uint32_t opcode = inst>>26;
+  switch(opcode)
+    {
+    case 0x00:
+      return decodeRType(inst);
+    case 0x02:
+      return mips_op::j;
+    case 0x03:
+      return mips_op::jal;
+    case 0x10:
+      return mips_op::coproc0;
+    case 0x11:
+      if(((inst >> 21) & 31) == 0x8) {
+	static const mips_op bc1[4] = {
+	  mips_op::bc1f, mips_op::bc1t, mips_op::bc1fl, mips_op::bc1tl
+	};
+	return bc1[(inst >> 16) & 3];
       }
-      case 0x22: /* sub */
-	printf("sub()\n");
-	exit(-1);
-	break;
-      case 0x23:{ /*subu*/  
-	uint32_t u_rs = (uint32_t)s->gpr[rs];
-	uint32_t u_rt = (uint32_t)s->gpr[rt];
-	uint32_t y = u_rs - u_rt;
-	s->gpr[rd] = y;
-	s->pc += 4;
-	break;
+      return mips_op::coproc1;
+    case 0x12:
+      return mips_op::coproc2;
+    case 0x13:
+      return mips_op::coproc1x;
+    case 0x1c:
+      return mips_op::special2;
+    case 0x1f:
+      return mips_op::special3;
+    case 0x30: /* ll */
+      return mips_op::lw;
+    case 0x38:
+      return mips_op::sc;
+    default:
+      break;
+    }
+  return decodeIType(inst);
+}
+
+template <bool EL>
+static void decodeInsn(uint32_t inst, uint32_t pc, decoded_insn &di) {
+  uint32_t uimm32 = inst & ((1<<16) - 1);
+  int32_t simm32 = static_cast<int32_t>(static_cast<int16_t>(uimm32));
+  di.inst = inst;
+  di.op = decodeOp(inst);
+  di.handler = getHandler<EL>(di.op);
+  di.rs = (inst >> 21) & 31;
+  di.rt = (inst >> 16) & 31;
+  di.rd = (inst >> 11) & 31;
+  di.sa = (inst >> 6) & 31;
+  switch(di.op)
+    {
+    case mips_op::andi:
+    case mips_op::ori:
+    case mips_op::xori:
+      di.imm = uimm32;
+      break;
+    case mips_op::lui:
+      di.imm = uimm32 << 16;
+      break;
+    case mips_op::j:
+    case mips_op::jal:
+      di.imm = ((inst & ((1<<26)-1)) << 2) | ((pc + 4) & (~((1<<28)-1)));
+      break;
+    default:
+      if(getOpKind(di.op) == mips_op_kind::br) {
+	di.imm = (simm32 << 2) + (pc + 4);
       }
-      case 0x24: /* and */
-	s->gpr[rd] = s->gpr[rs] & s->gpr[rt];
-	s->pc += 4;
-	break;
-      case 0x25: /* or */
-	s->gpr[rd] = s->gpr[rs] | s->gpr[rt];
-	s->pc += 4;
-	break;
-      case 0x26: /* xor */
-	s->gpr[rd] = s->gpr[rs] ^ s->gpr[rt];
-	s->pc += 4;
-	break;
-      case 0x27: /* nor */
-	s->gpr[rd] = ~(s->gpr[rs] | s->gpr[rt]);
-	s->pc += 4;
-	break;
-      case 0x2A: /* slt */
-	s->gpr[rd] = s->gpr[rs] < s->gpr[rt];
-	s->pc += 4;
-	break;
-      case 0x2B: { /* sltu */
-	uint32_t urs = (uint32_t)s->gpr[rs];
-	uint32_t urt = (uint32_t)s->gpr[rt];
-	s->gpr[rd] = (urs < urt);
-	s->pc += 4;
-	break;
+      else {
+	di.imm = simm32;
       }
-      case 0x0B: /* movn */
-	s->gpr[rd] = (s->gpr[rt] != 0) ? s->gpr[rs] : s->gpr[rd];
-	s->pc +=4;
-	break;
-      case 0x0A: /* movz */
-	s->gpr[rd] = (s->gpr[rt] == 0) ? s->gpr[rs] : s->gpr[rd];
-	s->pc += 4;
-	break;
-      case 0x34: /* teq */
-	if(s->gpr[rs] == s->gpr[rt]) {
-	  printf("teq trap!!!!!\n");
-	  exit(-1);
-	}
-	s->pc += 4;
-	break;
-      default:
-	printf("%sunknown RType instruction %x, funct = %d%s\n", 
-	       KRED, s->pc, funct, KNRM);
-	exit(-1);
-	break;
+      break;
+    }
+}
+
+template <bool EL>
+static mips_block *decodeBlock(state_t *s) {
+  static const uint32_t max_block_insns = 64;
+  uint32_t pc = s->pc;
+  mips_block *b = new mips_block(pc);
+  while(true) {
+    decoded_insn di;
+    decodeInsn<EL>(bswap<EL>(*(uint32_t*)(s->mem + pc)), pc, di);
+    b->insns.push_back(di);
+    b->n_issue++;
+    mips_op_kind k = getOpKind(di.op);
+    if(k == mips_op_kind::br) {
+      decoded_insn ds;
+      pc += 4;
+      decodeInsn<EL>(bswap<EL>(*(uint32_t*)(s->mem + pc)), pc, ds);
+      if(getOpKind(ds.op) == mips_op_kind::br) {
+	std::cerr << "branch in delay slot @ 0x" << std::hex
+		  << pc << std::dec << "\n";
+	die();
       }
-  }
-  else if(isSpecial2)
-    execSpecial2(inst,s);
-  else if(isSpecial3)
-    execSpecial3(inst,s);
-  else if(isJType) {
-    uint32_t jaddr = inst & ((1<<26)-1);
-    jaddr <<= 2;
-    if(opcode==0x2) { /* j */
-      s->pc += 4;
+      b->insns.push_back(ds);
+      break;
     }
-    else if(opcode==0x3) { /* jal */
-      s->gpr[31] = s->pc+8;
-      globals::rsb[globals::rsb_tos] = s->gpr[31];
-      globals::rsb_tos = (globals::rsb_tos - 1) & (globals::rsb_sz - 1);
-      s->pc += 4;
+    if((k == mips_op_kind::term) or (b->n_issue == max_block_insns)) {
+      break;
     }
-    else {
-      printf("Unknown JType instruction\n");
-      exit(-1);
+    pc += 4;
+  }
+  s->sim->bcache.insert(b);
+  return b;
+}
+
+template <bool EL>
+static inline void execDecoded(const decoded_insn *di, state_t *s) {
+  switch(di->op)
+    {
+#define ITEM(X,K) case mips_op::X: op_##X<EL>(di, s); break;
+      MIPS_OP_LIST(ITEM)
+#undef ITEM
+    default:
+      die();
+    }
+}
+
+template <bool EL>
+static inline mips_block *lookupBlock(state_t *s) {
+  mips_block *b = s->sim->bcache.lookup(s->pc);
+  return (b == nullptr) ? decodeBlock<EL>(s) : b;
+}
+
+/* follow the block's most recent exits before going
+ * back to the cache */
+template <bool EL>
+static inline mips_block *chainBlock(mips_block *from, state_t *s) {
+  for(int i = 0; i < 2; i++) {
+    if(from->succ[i] and (from->succ[i]->pc == s->pc)) {
+      return from->succ[i];
     }
-    jaddr |= (s->pc & (~((1<<28)-1)));
-    globals::bhr->shift_left(1);
-    globals::bhr->set_bit(0);    
-    execMips<EL>(s);
-    s->pc = jaddr;
   }
-  else if(isCoproc0) {  
-    switch(rs) 
-      {
-      case 0x0: /*mfc0*/
-	s->gpr[rt] = s->cpr0[rd];
-	break;
-      case 0x4: /*mtc0*/
-	s->cpr0[rd] = s->gpr[rt];
-	break;
-      default:
-	printf("unknown %s instruction @ %x", __func__, s->pc); exit(-1);
-	break;
-      }
-    s->pc += 4;
+  mips_block *b = lookupBlock<EL>(s);
+  from->succ[1] = from->succ[0];
+  from->succ[0] = b;
+  return b;
+}
+
+/* runs decoded blocks until budget instructions have issued,
+ * maxicnt is reached or a monitor call or break retires.
+ *
+ * the switch engine issues a block through one shared switch on
+ * the op class. the threaded engine jumps straight from handler
+ * to handler through a label table, so each handler gets its own
+ * indirect jump for the host to predict. blocks that have been
+ * entered jitThreshold times are handed to the jit and, once
+ * compiled, run natively whenever the budget covers the whole
+ * block.
+ *
+ * branches leave s->pc on their delay slot (or past it when
+ * annulled) and the address to continue at in s->br_target, so
+ * the delay slot is issued here rather than from inside the
+ * branch. a branch and its delay slot always retire together,
+ * which may overshoot the budget by one. */
+template <bool EL, bool THREADED>
+uint64_t execMipsN(state_t *s, uint64_t budget) {
+  const uint64_t start_icnt = s->icnt;
+  uint64_t icnt = start_icnt, stop = s->maxicnt;
+  uint32_t last_pc = s->last_pc;
+  if(icnt >= stop) {
+    return 0;
   }
-  else if(isCoproc1) 
-    execCoproc1<EL>(inst,s);
-  else if(isCoproc1x)
-    execCoproc1x<EL>(inst,s);
-  else if(isCoproc2) {
-    printf("coproc2 unimplemented\n");  exit(-1);
+  if(budget < (stop - icnt)) {
+    stop = icnt + budget;
   }
-  else if(isLoadLinked)
-    _lw<EL>(inst, s);
-  else if(isStoreCond)
-    _sc<EL>(inst, s);
-  else { /* itype */
-    uint32_t uimm32 = inst & ((1<<16) - 1);
-    int16_t simm16 = (int16_t)uimm32;
-    int32_t simm32 = (int32_t)simm16;
-    switch(opcode) 
-      {
-      case 0x01:
-	_bgez_bltz<EL>(inst, s); 
-	break;
-      case 0x04:
-	branch<EL,branch_type::beq>(inst, s); 
-	break;
-      case 0x05:
-	branch<EL,branch_type::bne>(inst, s); 
-	break;
-      case 0x06:
-	branch<EL,branch_type::blez>(inst, s); 
-	break;
-      case 0x07:
-	branch<EL,branch_type::bgtz>(inst, s); 
-	break;
-      case 0x08: /* addi */
-	s->gpr[rt] = s->gpr[rs] + simm32;  
-	s->pc+=4;
-	break;
-      case 0x09: /* addiu */
-	s->gpr[rt] = s->gpr[rs] + simm32;  
-	s->pc+=4;
-	break;
-      case 0x0A: /* slti */
-	s->gpr[rt] = (s->gpr[rs] < simm32);
-	s->pc += 4;
-	break;
-      case 0x0B:/* sltiu */
-	s->gpr[rt] = ((uint32_t)s->gpr[rs] < (uint32_t)simm32);
-	s->pc += 4;
-	break;
-      case 0x0c: /* andi */
-	s->gpr[rt] = s->gpr[rs] & uimm32;
-	s->pc += 4;
-	break;
-      case 0x0d: /* ori */
-	s->gpr[rt] = s->gpr[rs] | uimm32;
-	s->pc += 4;
-	break;
-      case 0x0e: /* xori */
-	s->gpr[rt] = s->gpr[rs] ^ uimm32;
-	s->pc += 4;
-	break;
-      case 0x0F: /* lui */
-	uimm32 <<= 16;
-	s->gpr[rt] = uimm32;
-	s->pc += 4;
-	break;
-      case 0x14:
-	branch<EL,branch_type::beql>(inst, s); 
-	break;
-      case 0x16:
-	branch<EL,branch_type::blezl>(inst, s); 
-	break;
-      case 0x15:
-	branch<EL,branch_type::bnel>(inst, s); 
-	break;
-      case 0x17:
-	branch<EL,branch_type::bgtzl>(inst, s); 
-	break;
-      case 0x20:
-	_lb<EL>(inst, s);
-	break;
-      case 0x21:
-	_lh<EL>(inst, s);
-	break;
-      case 0x22: 
-	_lwl<EL>(inst, s);
-	break;
-      case 0x23:
-	_lw<EL>(inst, s); 
-	break;
-      case 0x24:
-	_lbu<EL>(inst, s);
-	break;
-      case 0x25:
-	_lhu<EL>(inst, s);
-	break;
-      case 0x26:
-	_lwr<EL>(inst, s);
-	break;
-      case 0x28:
-	_sb(inst, s); 
-	break;
-      case 0x29:
-	_sh<EL>(inst, s); 
-	break;
-      case 0x2a:
-	_swl<EL>(inst, s); 
-	break;
-      case 0x2B:
-	_sw<EL>(inst, s); 
-	break;
-      case 0x2e:
-	_swr<EL>(inst, s); 
-	break;
-      case 0x31:
-	_lwc1<EL>(inst, s);
-	break;  
-      case 0x35:
-	_ldc1<EL>(inst, s);
-	break;
-      case 0x39:
-	_swc1<EL>(inst, s);
-	break;
-      case 0x3D:
-	_sdc1<EL>(inst, s);
-	break;
-      default:
-	printf("%s: Unknown IType instruction (bits=%x) @ pc=0x%08x\n", 
-	       __func__, inst, s ? s->pc : 0);
-	exit(-1);
-	break;
+  mips_block *b = lookupBlock<EL>(s);
+  while(true) {
+    const decoded_insn *di = b->insns.data();
+    uint64_t n = b->n_issue;
+    if((stop - icnt) < n) {
+      n = stop - icnt;
+    }
+    const decoded_insn *end = di + n;
+    /* the delay slot, issued by the same loop as one more
+     * instruction unless its branch annulled it */
+    bool slot = (n == b->n_issue) and (n != b->insns.size());
+    const uint32_t slot_pc = b->pc + 4*n;
+    /* a block's branch is its last issued instruction, so this
+     * is the count the trace records for it */
+    if(s->sim->trace) {
+      s->icnt = icnt + n;
+    }
+    if((b->native == nullptr) and globals::jitThreshold and
+       (++b->n_execs == globals::jitThreshold)) {
+      b->native = jitCompile(b, EL);
+    }
+    if(b->native and (n == b->n_issue)) {
+      b->native(s);
+      di = end;
+    }
+    if(THREADED) {
+#ifdef HAVE_THREADED_DISPATCH
+      static void * const labels[] = {
+#define ITEM(X,K) &&L_##X,
+	MIPS_OP_LIST(ITEM)
+#undef ITEM
+      };
+      if(di == end) {
+	goto issued;
+      }
+      goto *labels[static_cast<size_t>(di->op)];
+#define ITEM(X,K)							\
+      L_##X:								\
+	op_##X<EL>(di, s);						\
+	if(++di != end) {						\
+	  goto *labels[static_cast<size_t>(di->op)];			\
+	}								\
+	goto issued;
+      MIPS_OP_LIST(ITEM)
+#undef ITEM
+    issued:
+      if(slot and (s->pc == slot_pc)) {
+	slot = false;
+	end++;
+	goto *labels[static_cast<size_t>(di->op)];
       }
+#endif
+    }
+    else {
+      while(true) {
+	for(; di != end; di++) {
+	  execDecoded<EL>(di, s);
+	}
+	if(not(slot) or (s->pc != slot_pc)) {
+	  break;
+	}
+	slot = false;
+	end++;
+      }
+    }
+    const uint64_t m = end - b->insns.data();
+    icnt += m;
+    last_pc = b->pc + 4*(m-1);
+    if(n != b->n_issue) {
+      break;
+    }
+    if(n != b->insns.size()) {
+      s->pc = s->br_target;
+    }
+    else if(getOpKind(b->insns[n-1].op) == mips_op_kind::term) {
+      break;
+    }
+    if(icnt >= stop) {
+      break;
+    }
+    b = chainBlock<EL>(b, s);
   }
+  s->last_pc = last_pc;
+  s->icnt = icnt;
+  return icnt - start_icnt;
 }
@@ -98,8 +98,10 @@ union mips_t {
 };
 
 void initState(state_t *s);
-void execMipsEL(state_t *s);
-void execMips(state_t *s);
+/* runs up to budget instructions of sim's program and returns
+ * how many issued */
+uint64_t execMipsN(simulation *sim, uint64_t budget);
+bool haveThreadedDispatch();
 void mkMonitorVectors(state_t *s);
 std::ostream &operator<<(std::ostream &out, const state_t & s);
 #endif
@@ -0,0 +1,467 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <unordered_map>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+#include "replacementPolicy.hh"
+#include "helper.hh"
+
+#define PAIR(X) {#X, replacement_policy::repl_policy::X},
+const std::map<std::string, replacement_policy::repl_policy> replacement_policy::repl_policy_map = {
+  REPL_POLICY_LIST(PAIR)
+};
+#undef PAIR
+
+bool repl_config::set(const std::string &key, const std::string &v) {
+  if(key == "rrpv_bits") {
+    return parseNumber(v, rrpv_bits);
+  }
+  else if(key == "brrip_lg_prob") {
+    return parseNumber(v, brrip_lg_prob);
+  }
+  else if(key == "leader_sets") {
+    return parseNumber(v, leader_sets);
+  }
+  else if(key == "psel_bits") {
+    return parseNumber(v, psel_bits);
+  }
+  else if(key == "trace") {
+    trace = v;
+    return true;
+  }
+  return false;
+}
+
+bool repl_config::valid() const {
+  auto it = replacement_policy::repl_policy_map.find(policy);
+  if(it == replacement_policy::repl_policy_map.end()) {
+    return false;
+  }
+  if(it->second == replacement_policy::repl_policy::opt and trace.empty()) {
+    return false;
+  }
+  return (rrpv_bits != 0) and (rrpv_bits <= 7) and
+    (brrip_lg_prob <= 16) and (leader_sets != 0) and
+    (psel_bits != 0) and (psel_bits <= 16);
+}
+
+bool repl_config::parse(const std::string &spec) {
+  spec_pairs kvs;
+  if(not(splitSpec(spec, &policy, kvs))) {
+    return false;
+  }
+  for(const auto &kv : kvs) {
+    if(not(set(kv.first, kv.second))) {
+      return false;
+    }
+  }
+  return valid();
+}
+
+std::string repl_config::str() const {
+  std::stringstream ss;
+  ss << policy;
+  if(policy == "srrip" or policy == "brrip" or policy == "drrip") {
+    ss << ",rrpv_bits=" << rrpv_bits;
+  }
+  if(policy == "brrip" or policy == "drrip") {
+    ss << ",brrip_lg_prob=" << brrip_lg_prob;
+  }
+  if(policy == "drrip") {
+    ss << ",leader_sets=" << leader_sets
+       << ",psel_bits=" << psel_bits;
+  }
+  if(policy == "opt") {
+    ss << ",trace=" << trace;
+  }
+  return ss.str();
+}
+
+replacement_policy *replacement_policy::make(const repl_config &c, size_t assoc,
+					     size_t num_sets, size_t lg_line) {
+  switch(repl_policy_map.at(c.policy))
+    {
+    case repl_policy::plru:
+      return new plru_policy(c, assoc, num_sets);
+    case repl_policy::nru:
+      return new nru_policy(c, assoc, num_sets);
+    case repl_policy::random:
+      return new random_policy(c, assoc, num_sets);
+    case repl_policy::srrip:
+    case repl_policy::brrip:
+    case repl_policy::drrip:
+      return new rrip_policy(c, assoc, num_sets);
+    case repl_policy::opt:
+      return new opt_policy(c, assoc, num_sets, lg_line);
+    default:
+    case repl_policy::lru:
+      break;
+    }
+  if(assoc > 256) {
+    return new lru_policy<uint16_t>(c, assoc, num_sets);
+  }
+  return new lru_policy<uint8_t>(c, assoc, num_sets);
+}
+
+static const uint64_t ones8 = 0x0101010101010101UL;
+static const uint64_t highs8 = 0x8080808080808080UL;
+
+/* ages older than a get one older. a set of 8 or fewer ways has
+ * ages below 8, so they fit one word with no carries between them.
+ * such sets are padded to 8 bytes with zeros, which stay zero */
+static inline void age_below(uint8_t *ages, size_t n, uint8_t a) {
+  size_t i = 0;
+#ifdef __AVX2__
+  /* biased by 0x80 so the signed compare orders them unsigned */
+  const __m256i bias32 = _mm256_set1_epi8(static_cast<char>(0x80));
+  const __m256i a32 = _mm256_set1_epi8(static_cast<char>(a ^ 0x80));
+  for(; (i + 32) <= n; i += 32) {
+    __m256i *p = reinterpret_cast<__m256i*>(ages + i);
+    __m256i v = _mm256_loadu_si256(p);
+    __m256i lt = _mm256_cmpgt_epi8(a32, _mm256_xor_si256(v, bias32));
+    _mm256_storeu_si256(p, _mm256_sub_epi8(v, lt));
+  }
+#endif
+#ifdef __SSE2__
+  const __m128i bias16 = _mm_set1_epi8(static_cast<char>(0x80));
+  const __m128i a16 = _mm_set1_epi8(static_cast<char>(a ^ 0x80));
+  for(; (i + 16) <= n; i += 16) {
+    __m128i *p = reinterpret_cast<__m128i*>(ages + i);
+    __m128i v = _mm_loadu_si128(p);
+    __m128i lt = _mm_cmpgt_epi8(a16, _mm_xor_si128(v, bias16));
+    _mm_storeu_si128(p, _mm_sub_epi8(v, lt));
+  }
+#endif
+  if(n <= 8) {
+    uint64_t v;
+    memcpy(&v, ages, 8);
+    /* high bit of each byte set where it is <= a-1 */
+    uint64_t le = (((a - 1) * ones8) | highs8) - v;
+    v += ((le & highs8) >> 7) & (ones8 >> (64 - 8*n));
+    memcpy(ages, &v, 8);
+    return;
+  }
+  for(; i < n; i++) {
+    ages[i] += (ages[i] < a);
+  }
+}
+
+/* the way whose age is a, the oldest when a is n-1 */
+static inline size_t find_age(const uint8_t *ages, size_t n, uint8_t a) {
+  size_t i = 0;
+#ifdef __AVX2__
+  const __m256i a32 = _mm256_set1_epi8(static_cast<char>(a));
+  for(; (i + 32) <= n; i += 32) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ages + i));
+    uint32_t m = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, a32));
+    if(m) {
+      return i + __builtin_ctz(m);
+    }
+  }
+#endif
+#ifdef __SSE2__
+  const __m128i a16 = _mm_set1_epi8(static_cast<char>(a));
+  for(; (i + 16) <= n; i += 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ages + i));
+    uint32_t m = _mm_movemask_epi8(_mm_cmpeq_epi8(v, a16));
+    if(m) {
+      return i + __builtin_ctz(m);
+    }
+  }
+#endif
+  if(n <= 8) {
+    uint64_t v;
+    memcpy(&v, ages, 8);
+    v ^= a * ones8;
+    /* the lowest zero byte */
+    uint64_t z = (v - ones8) & ~v & highs8;
+    return __builtin_ctzll(z) / 8;
+  }
+  for(; i < n; i++) {
+    if(ages[i] == a) {
+      return i;
+    }
+  }
+  die();
+  return n;
+}
+
+/* the same for the 16 bit ages of sets over 256 ways */
+static inline void age_below(uint16_t *ages, size_t n, uint16_t a) {
+  size_t i = 0;
+#ifdef __AVX2__
+  const __m256i bias16 = _mm256_set1_epi16(static_cast<short>(0x8000));
+  const __m256i a16 = _mm256_set1_epi16(static_cast<short>(a ^ 0x8000));
+  for(; (i + 16) <= n; i += 16) {
+    __m256i *p = reinterpret_cast<__m256i*>(ages + i);
+    __m256i v = _mm256_loadu_si256(p);
+    __m256i lt = _mm256_cmpgt_epi16(a16, _mm256_xor_si256(v, bias16));
+    _mm256_storeu_si256(p, _mm256_sub_epi16(v, lt));
+  }
+#endif
+#ifdef __SSE2__
+  const __m128i bias8 = _mm_set1_epi16(static_cast<short>(0x8000));
+  const __m128i a8 = _mm_set1_epi16(static_cast<short>(a ^ 0x8000));
+  for(; (i + 8) <= n; i += 8) {
+    __m128i *p = reinterpret_cast<__m128i*>(ages + i);
+    __m128i v = _mm_loadu_si128(p);
+    __m128i lt = _mm_cmpgt_epi16(a8, _mm_xor_si128(v, bias8));
+    _mm_storeu_si128(p, _mm_sub_epi16(v, lt));
+  }
+#endif
+  for(; i < n; i++) {
+    ages[i] += (ages[i] < a);
+  }
+}
+
+/* movemask gives two bits for each 16 bit age */
+static inline size_t find_age(const uint16_t *ages, size_t n, uint16_t a) {
+  size_t i = 0;
+#ifdef __AVX2__
+  const __m256i a16 = _mm256_set1_epi16(static_cast<short>(a));
+  for(; (i + 16) <= n; i += 16) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ages + i));
+    uint32_t m = _mm256_movemask_epi8(_mm256_cmpeq_epi16(v, a16));
+    if(m) {
+      return i + __builtin_ctz(m) / 2;
+    }
+  }
+#endif
+#ifdef __SSE2__
+  const __m128i a8 = _mm_set1_epi16(static_cast<short>(a));
+  for(; (i + 8) <= n; i += 8) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ages + i));
+    uint32_t m = _mm_movemask_epi8(_mm_cmpeq_epi16(v, a8));
+    if(m) {
+      return i + __builtin_ctz(m) / 2;
+    }
+  }
+#endif
+  for(; i < n; i++) {
+    if(ages[i] == a) {
+      return i;
+    }
+  }
+  die();
+  return n;
+}
+
+template <typename A>
+lru_policy<A>::lru_policy(const repl_config &c, size_t assoc, size_t num_sets) :
+  replacement_policy(c, assoc, num_sets),
+  age_stride(std::max<size_t>(8, assoc)) {
+  if((assoc - 1) > static_cast<A>(~0)) {
+    std::cerr << "lru_policy : ages are " << 8*sizeof(A)
+	      << " bits, at most " << (1UL << (8*sizeof(A))) << " ways\n";
+    die();
+  }
+  ages.assign(num_sets * age_stride, 0);
+  flush();
+}
+
+template <typename A>
+void lru_policy<A>::flush() {
+  for(size_t l = 0; l < num_sets; l++) {
+    for(size_t w = 0; w < assoc; w++) {
+      ages[l * age_stride + w] = (assoc - 1) - w;
+    }
+  }
+}
+
+template <typename A>
+void lru_policy<A>::touch(uint32_t set, size_t way) {
+  A *a = &ages[set * age_stride];
+  /* most accesses go back to the line they last used */
+  if(a[way] != 0) {
+    age_below(a, assoc, a[way]);
+    a[way] = 0;
+  }
+}
+
+template <typename A>
+size_t lru_policy<A>::victim(uint32_t set) {
+  return find_age(&ages[set * age_stride], assoc, static_cast<A>(assoc - 1));
+}
+
+template class lru_policy<uint8_t>;
+template class lru_policy<uint16_t>;
+
+plru_policy::plru_policy(const repl_config &c, size_t assoc, size_t num_sets) :
+  replacement_policy(c, assoc, num_sets), bits(num_sets * assoc, 0) {}
+
+void plru_policy::flush() {
+  std::fill(bits.begin(), bits.end(), 0);
+}
+
+/* node n has children 2n and 2n+1 and ways are the leaves
+ * assoc..2*assoc-1, so the root is node 1 and node 0 is unused */
+void plru_policy::touch(uint32_t set, size_t way) {
+  uint8_t *b = &bits[set * assoc];
+  for(size_t n = way + assoc; n > 1; n >>= 1) {
+    /* point the parent away from this side */
+    b[n >> 1] = (n & 1) ^ 1;
+  }
+}
+
+size_t plru_policy::victim(uint32_t set) {
+  const uint8_t *b = &bits[set * assoc];
+  size_t n = 1;
+  while(n < assoc) {
+    n = 2*n + b[n];
+  }
+  return n - assoc;
+}
+
+nru_policy::nru_policy(const repl_config &c, size_t assoc, size_t num_sets) :
+  replacement_policy(c, assoc, num_sets), used(num_sets * assoc, 0) {}
+
+void nru_policy::flush() {
+  std::fill(used.begin(), used.end(), 0);
+}
+
+void nru_policy::touch(uint32_t set, size_t way) {
+  uint8_t *u = &used[set * assoc];
+  u[way] = 1;
+  if(std::find(u, u + assoc, 0) == (u + assoc)) {
+    std::fill(u, u + assoc, 0);
+    u[way] = 1;
+  }
+}
+
+size_t nru_policy::victim(uint32_t set) {
+  const uint8_t *u = &used[set * assoc];
+  return std::find(u, u + assoc, 0) - u;
+}
+
+rrip_policy::rrip_policy(const repl_config &c, size_t assoc, size_t num_sets) :
+  replacement_policy(c, assoc, num_sets),
+  kind(repl_policy_map.at(c.policy)),
+  max_rrpv((1U << c.rrpv_bits) - 1) {
+  rrpv.assign(num_sets * assoc, max_rrpv);
+  /* one srrip and one brrip leader in every leader_stride sets,
+   * so at least half the sets follow psel */
+  if((kind == repl_policy::drrip) and (num_sets < 4)) {
+    std::cerr << KRED << "drrip needs at least 4 sets to have follower sets" << KNRM << "\n";
+    exit(-1);
+  }
+  leader_stride = std::max<uint32_t>(4, num_sets / c.leader_sets);
+  psel_max = (1U << c.psel_bits) - 1;
+  psel = psel_max / 2;
+}
+
+void rrip_policy::flush() {
+  std::fill(rrpv.begin(), rrpv.end(), max_rrpv);
+}
+
+bool rrip_policy::bimodal_fill(uint32_t set) {
+  if(kind == repl_policy::srrip) {
+    return false;
+  }
+  if(kind == repl_policy::drrip) {
+    /* every fill is a miss, charged to the leader's policy */
+    switch(set % leader_stride)
+      {
+      case 0:
+	psel += (psel != psel_max);
+	return false;
+      case 1:
+	psel -= (psel != 0);
+	return true;
+      default:
+	if(psel <= (psel_max / 2)) {
+	  return false;
+	}
+	break;
+      }
+  }
+  return true;
+}
+
+void rrip_policy::fill(uint32_t set, size_t way, uint32_t line) {
+  uint8_t v = max_rrpv - 1;
+  if(bimodal_fill(set)) {
+    if(rng.next() & ((1U << cfg.brrip_lg_prob) - 1)) {
+      v = max_rrpv;
+    }
+  }
+  rrpv[set * assoc + way] = v;
+}
+
+/* the first way predicted to be re-referenced most distantly,
+ * after ageing the whole set until there is one */
+size_t rrip_policy::victim(uint32_t set) {
+  uint8_t *r = &rrpv[set * assoc];
+  uint8_t *oldest = std::max_element(r, r + assoc);
+  const uint8_t d = max_rrpv - *oldest;
+  if(d) {
+    for(size_t w = 0; w < assoc; w++) {
+      r[w] += d;
+    }
+  }
+  return oldest - r;
+}
+
+const uint32_t opt_policy::never;
+
+opt_policy::opt_policy(const repl_config &c, size_t assoc, size_t num_sets, size_t lg_line) :
+  replacement_policy(c, assoc, num_sets), way_next(num_sets * assoc, never) {
+  FILE *fp = fopen(c.trace.c_str(), "rb");
+  if(fp == nullptr) {
+    std::cerr << KRED << "unable to open memory trace " << c.trace << KNRM << "\n";
+    exit(-1);
+  }
+  uint32_t hdr[2] = {0};
+  if((fread(hdr, sizeof(hdr), 1, fp) != 1) or
+     (hdr[0] != trace_magic) or (hdr[1] != trace_version)) {
+    std::cerr << KRED << c.trace << " is not a memory trace" << KNRM << "\n";
+    exit(-1);
+  }
+  uint32_t buf[4096];
+  size_t n;
+  while((n = fread(buf, sizeof(uint32_t), 4096, fp)) != 0) {
+    for(size_t i = 0; i < n; i++) {
+      lines.push_back(buf[i] >> lg_line);
+    }
+  }
+  fclose(fp);
+  if(lines.size() >= never) {
+    std::cerr << KRED << "memory trace " << c.trace << " is too long" << KNRM << "\n";
+    exit(-1);
+  }
+  next_use.resize(lines.size());
+  std::unordered_map<uint32_t, uint32_t> seen;
+  for(size_t i = lines.size(); i != 0; i--) {
+    auto it = seen.find(lines[i-1]);
+    next_use[i-1] = (it == seen.end()) ? never : it->second;
+    seen[lines[i-1]] = i-1;
+  }
+}
+
+void opt_policy::flush() {
+  std::fill(way_next.begin(), way_next.end(), never);
+}
+
+/* checks this access against the trace and moves past it */
+void opt_policy::advance(uint32_t line) {
+  if((pos == lines.size()) or (lines[pos] != line)) {
+    std::cerr << KRED << "memory trace " << cfg.trace
+	      << " does not match this run at access " << pos << KNRM << "\n";
+    exit(-1);
+  }
+  pos++;
+}
+
+void opt_policy::touch(uint32_t set, size_t way, uint32_t line) {
+  advance(line);
+  way_next[set * assoc + way] = next_use[pos - 1];
+}
+
+size_t opt_policy::victim(uint32_t set) {
+  const uint32_t *n = &way_next[set * assoc];
+  return std::max_element(n, n + assoc) - n;
+}
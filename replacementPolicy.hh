@@ -0,0 +1,208 @@
+#ifndef __REPLACEMENT_POLICY_HH__
+#define __REPLACEMENT_POLICY_HH__
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "helper.hh"
+
+#define REPL_POLICY_LIST(BA) \
+  BA(lru)		     \
+  BA(plru)		     \
+  BA(nru)		     \
+  BA(random)		     \
+  BA(srrip)		     \
+  BA(brrip)		     \
+  BA(drrip)		     \
+  BA(opt)
+
+/* a cache replacement policy, written as policy[,key=value...],
+ * e.g. "drrip,rrpv_bits=3" or "opt,trace=l1d.mtr" */
+struct repl_config {
+  std::string policy = "lru";
+  /* re-reference prediction values of the rrip policies */
+  uint32_t rrpv_bits = 2;
+  /* brrip inserts at long rather than distant re-reference
+   * once every 2^brrip_lg_prob fills */
+  uint32_t brrip_lg_prob = 5;
+  /* drrip duels this many leader sets of each policy, but at most
+   * num_sets/4 of each so the rest follow. it needs 4 sets */
+  uint32_t leader_sets = 32;
+  uint32_t psel_bits = 10;
+  /* the memory trace opt looks ahead in, written with --mem_trace
+   * by an earlier run of the same program */
+  std::string trace;
+  bool parse(const std::string &spec);
+  bool set(const std::string &key, const std::string &val);
+  bool valid() const;
+  std::string str() const;
+};
+
+/* picks victims for a cache of num_sets sets of assoc ways. the
+ * cache fills invalid ways itself and only asks for a victim once
+ * a set is full. every access then ends in exactly one hit, fill
+ * or, for a miss that doesn't allocate, skip, which get the line
+ * address for policies that care */
+class replacement_policy {
+public:
+#define ITEM(X) X,
+  enum class repl_policy {
+    REPL_POLICY_LIST(ITEM)
+  };
+#undef ITEM
+  static const std::map<std::string, repl_policy> repl_policy_map;
+protected:
+  repl_config cfg;
+  size_t assoc, num_sets;
+public:
+  replacement_policy(const repl_config &c, size_t assoc, size_t num_sets) :
+    cfg(c), assoc(assoc), num_sets(num_sets) {}
+  virtual ~replacement_policy() {}
+  virtual void hit(uint32_t set, size_t way, uint32_t line) = 0;
+  virtual void fill(uint32_t set, size_t way, uint32_t line) = 0;
+  virtual size_t victim(uint32_t set) = 0;
+  virtual void skip(uint32_t line) {}
+  /* forgets recency after the cache is flushed */
+  virtual void flush() {}
+  std::string str() const {
+    return cfg.str();
+  }
+  /* lg_line is the cache's line size, which opt needs to turn
+   * its trace into lines */
+  static replacement_policy *make(const repl_config &c, size_t assoc,
+				  size_t num_sets, size_t lg_line);
+};
+
+/* true lru. a set's ages are a permutation of 0..assoc-1, 0 for
+ * the most recently used way, so the victim is the way aged
+ * assoc-1. ways never used start out oldest in way order. ages
+ * are bytes up to 256 ways and 16 bits above that */
+template <typename A>
+class lru_policy : public replacement_policy {
+private:
+  size_t age_stride;
+  std::vector<A> ages;
+  void touch(uint32_t set, size_t way);
+public:
+  lru_policy(const repl_config &c, size_t assoc, size_t num_sets);
+  void hit(uint32_t set, size_t way, uint32_t line) override {
+    touch(set, way);
+  }
+  void fill(uint32_t set, size_t way, uint32_t line) override {
+    touch(set, way);
+  }
+  size_t victim(uint32_t set) override;
+  void flush() override;
+};
+
+/* tree pseudo-lru. assoc-1 bits per set form a binary tree over
+ * the ways, each pointing at the half to evict from next */
+class plru_policy : public replacement_policy {
+private:
+  std::vector<uint8_t> bits;
+  void touch(uint32_t set, size_t way);
+public:
+  plru_policy(const repl_config &c, size_t assoc, size_t num_sets);
+  void hit(uint32_t set, size_t way, uint32_t line) override {
+    touch(set, way);
+  }
+  void fill(uint32_t set, size_t way, uint32_t line) override {
+    touch(set, way);
+  }
+  size_t victim(uint32_t set) override;
+  void flush() override;
+};
+
+/* not recently used. one bit per way, set on use; when the last
+ * clear bit in a set would go, every other bit is cleared. the
+ * victim is the first way with a clear bit */
+class nru_policy : public replacement_policy {
+private:
+  std::vector<uint8_t> used;
+  void touch(uint32_t set, size_t way);
+public:
+  nru_policy(const repl_config &c, size_t assoc, size_t num_sets);
+  void hit(uint32_t set, size_t way, uint32_t line) override {
+    touch(set, way);
+  }
+  void fill(uint32_t set, size_t way, uint32_t line) override {
+    touch(set, way);
+  }
+  size_t victim(uint32_t set) override;
+  void flush() override;
+};
+
+class random_policy : public replacement_policy {
+private:
+  xorshift32 rng;
+public:
+  random_policy(const repl_config &c, size_t assoc, size_t num_sets) :
+    replacement_policy(c, assoc, num_sets) {}
+  void hit(uint32_t set, size_t way, uint32_t line) override {}
+  void fill(uint32_t set, size_t way, uint32_t line) override {}
+  size_t victim(uint32_t set) override {
+    return rng.next() & (assoc - 1);
+  }
+};
+
+/* re-reference interval prediction (jaleel et al, isca 2010).
+ * hits predict a near re-reference. srrip fills predict a long
+ * one, brrip fills mostly a distant one, and drrip picks between
+ * the two with a psel counter trained on leader sets that always
+ * use one or the other */
+class rrip_policy : public replacement_policy {
+private:
+  repl_policy kind;
+  uint8_t max_rrpv;
+  std::vector<uint8_t> rrpv;
+  xorshift32 rng;
+  uint32_t leader_stride = 0;
+  uint32_t psel = 0, psel_max = 0;
+  bool bimodal_fill(uint32_t set);
+public:
+  rrip_policy(const repl_config &c, size_t assoc, size_t num_sets);
+  void hit(uint32_t set, size_t way, uint32_t line) override {
+    rrpv[set * assoc + way] = 0;
+  }
+  void fill(uint32_t set, size_t way, uint32_t line) override;
+  size_t victim(uint32_t set) override;
+  void flush() override;
+};
+
+/* belady's optimal policy: evicts the line used furthest in the
+ * future. that future is a trace of the same cache's accesses,
+ * which this run must repeat exactly */
+class opt_policy : public replacement_policy {
+public:
+  /* a memory trace is the two words trace_magic and trace_version
+   * followed by the address of every access, one word each */
+  static const uint32_t trace_magic = 0x4352544d;
+  static const uint32_t trace_version = 1;
+private:
+  static const uint32_t never = ~0U;
+  std::vector<uint32_t> lines;
+  /* for each access, the position of the next access to its line */
+  std::vector<uint32_t> next_use;
+  /* the next use of the line in every way */
+  std::vector<uint32_t> way_next;
+  size_t pos = 0;
+  void advance(uint32_t line);
+  void touch(uint32_t set, size_t way, uint32_t line);
+public:
+  opt_policy(const repl_config &c, size_t assoc, size_t num_sets, size_t lg_line);
+  void hit(uint32_t set, size_t way, uint32_t line) override {
+    touch(set, way, line);
+  }
+  void fill(uint32_t set, size_t way, uint32_t line) override {
+    touch(set, way, line);
+  }
+  size_t victim(uint32_t set) override;
+  void skip(uint32_t line) override {
+    advance(line);
+  }
+  void flush() override;
+};
+
+#endif
@@ -0,0 +1,251 @@
+#include <cstdio>
+#include <iostream>
+#include <fstream>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <boost/program_options.hpp>
+
+#include "helper.hh"
+#include "sim_bitvec.hh"
+#include "branch_predictor.hh"
+#include "branchTrace.hh"
+#include "branchTargetBuffer.hh"
+#include "returnStack.hh"
+#include "sweep.hh"
+
+extern const char* githash;
+
+/* the trace has no instruction bytes, so unlike bpred_mips
+ * this only lists addresses */
+static void dump_histo(const std::string &fname,
+		       const std::map<uint32_t, uint64_t> &histo) {
+  std::vector<std::pair<uint64_t, uint32_t>> sorted_by_cnt;
+  for(auto &p : histo) {
+    sorted_by_cnt.emplace_back(p.second, p.first);
+  }
+  std::ofstream out(fname);
+  std::sort(sorted_by_cnt.begin(), sorted_by_cnt.end());
+  for(auto it = sorted_by_cnt.rbegin(), E = sorted_by_cnt.rend(); it != E; ++it) {
+    out << std::hex << it->second << ","
+	<< std::dec << it->first << "\n";
+  }
+  out.close();
+}
+
+/* the parts of a simulation that a trace can drive */
+struct replay_ctx {
+  predictor_group predictors;
+  branch_predictor *bpred = nullptr;
+  return_stack *rsb = nullptr;
+  branch_target_buffer *btb = nullptr;
+  ~replay_ctx() {
+    delete rsb;
+    delete btb;
+  }
+};
+
+/* mirrors what the interpreter does at each branch and jump */
+static void replay(replay_ctx &x, branchTraceReader &tr, uint64_t &icnt) {
+  branch_record r;
+  while(tr.next(r)) {
+    icnt = r.icnt;
+    if(x.btb) {
+      bool direct = (r.kind == branch_kind::cond) or (r.kind == branch_kind::jump) or
+	(r.kind == branch_kind::call);
+      x.btb->access(r.pc, r.target, r.taken, direct);
+    }
+    switch(r.kind)
+      {
+      case branch_kind::cond:
+	x.predictors.branch(r.pc, r.taken);
+	continue;
+      case branch_kind::indirect:
+	x.predictors.indirect_jump(r.pc, r.target);
+	break;
+      case branch_kind::icall:
+	x.predictors.indirect_jump(r.pc, r.target);
+	/* fall through */
+      case branch_kind::call:
+	x.rsb->push(r.pc + 8);
+	break;
+      case branch_kind::ret:
+	if(not(x.rsb->pop(r.target))) {
+	  x.bpred->getMap()[r.pc]++;
+	}
+	break;
+      default:
+	break;
+      }
+    x.predictors.jump();
+  }
+  icnt = r.icnt;
+}
+
+int main(int argc, char *argv[]) {
+  namespace po = boost::program_options;
+
+  std::cerr << KGRN
+	    << "BPRED REPLAY : built "
+	    << __DATE__ << " " << __TIME__
+	    << ",hostname="<<gethostname()
+	    << "\n"
+	    << "git hash=" << githash
+	    << KNRM << "\n";
+
+  std::string trace, bpred_impl, ipred_spec, btb_spec, rsb_spec, results;
+  std::vector<std::string> bpred_specs;
+  size_t bhr_len;
+  uint32_t lg_pht_sz, lg_c_pht_sz, lg_rsb_sz, pc_shift;
+  size_t n_threads;
+  uint64_t chunk_records, warmup;
+  po::options_description desc("Options");
+  po::variables_map vm;
+
+  try {
+    desc.add_options()
+      ("help", "Print help messages")
+      ("trace,t", po::value<std::string>(&trace), "branch trace from bpred_mips --trace_out")
+      ("bhr_len", po::value<size_t>(&bhr_len)->default_value(32), "branch history length")
+      ("lg_pht_sz", po::value<uint32_t>(&lg_pht_sz)->default_value(16), "lg2(pht) sz")
+      ("lg_rsb_sz", po::value<uint32_t>(&lg_rsb_sz)->default_value(2), "lg2(rsb) sz")
+      ("lg_c_pht_sz", po::value<uint32_t>(&lg_c_pht_sz)->default_value(16), "lg2(choice pht) sz (bimodal predictor)")
+      ("bpred_impl", po::value<std::string>(&bpred_impl), "branch predictor (string)")
+      ("bpred", po::value<std::vector<std::string>>(&bpred_specs)->composing(), "add a predictor as impl[,key=value...], repeat to run several at once")
+      ("ipred", po::value<std::string>(&ipred_spec)->default_value("last_target"), "indirect jump predictor as impl[,key=value...]")
+      ("rsb", po::value<std::string>(&rsb_spec)->default_value(""), "return stack as key=value[,...] (depth, policy, valid_bits), depth overrides lg_rsb_sz")
+      ("btb", po::value<std::string>(&btb_spec), "model a btb with geometry key=value[,...] (lg_entries, ways, tag_bits, repl), \"\" for the defaults")
+      ("pc_shift", po::value<uint32_t>(&pc_shift)->default_value(3), "shift dist pc in gshare")
+      ("threads", po::value<size_t>(&n_threads)->default_value(0), "sweep the predictor configs on this many threads")
+      ("chunk", po::value<uint64_t>(&chunk_records)->default_value(0), "records per sweep job (0 replays each config in one job)")
+      ("warmup", po::value<uint64_t>(&warmup)->default_value(0), "uncounted records replayed ahead of each chunk")
+      ("results", po::value<std::string>(&results)->default_value("sweep.csv"), "csv file for sweep results")
+      ;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+  }
+  catch(po::error &e) {
+    std::cerr << KRED << "command-line error : " << e.what() << KNRM << "\n";
+    return -1;
+  }
+
+  if(vm.count("help")) {
+    std::cout << desc << "\n";
+    return 0;
+  }
+  if(trace.size() == 0) {
+    std::cerr << "REPLAY : no trace\n";
+    return -1;
+  }
+
+  uint64_t icnt = 0;
+  bpred_config base_config;
+  if(branch_predictor::lookup_impl(bpred_impl) != branch_predictor::bpred_impl::unknown) {
+    base_config.impl = bpred_impl;
+  }
+  base_config.lg_pht_sz = lg_pht_sz;
+  base_config.lg_c_pht_sz = lg_c_pht_sz;
+  base_config.pc_shift = pc_shift;
+  base_config.bhr_len = bhr_len;
+  if(not(base_config.valid())) {
+    std::cerr << KRED << "bad predictor config " << base_config.str() << KNRM << "\n";
+    return -1;
+  }
+
+  std::vector<bpred_config> configs;
+  if(bpred_specs.empty()) {
+    configs.push_back(base_config);
+  }
+  for(const std::string &grid : bpred_specs) {
+    for(const std::string &spec : expandGrid(grid)) {
+      bpred_config c = base_config;
+      if(not(c.parse(spec))) {
+	std::cerr << KRED << "bad predictor config " << spec << KNRM << "\n";
+	return -1;
+      }
+      configs.push_back(c);
+    }
+  }
+
+  ipred_config ic;
+  if(not(ic.parse(ipred_spec))) {
+    std::cerr << KRED << "bad indirect predictor config " << ipred_spec << KNRM << "\n";
+    return -1;
+  }
+  btb_config bc;
+  if(vm.count("btb") and not(bc.parse(btb_spec))) {
+    std::cerr << KRED << "bad btb config " << btb_spec << KNRM << "\n";
+    return -1;
+  }
+  rsb_config rc;
+  rc.depth = 1U << lg_rsb_sz;
+  if(not(rc.parse(rsb_spec))) {
+    std::cerr << KRED << "bad rsb config " << rsb_spec << KNRM << "\n";
+    return -1;
+  }
+
+  branchTraceReader tr(trace);
+  if(n_threads) {
+    double runtime = timestamp();
+    std::vector<sweep_result> r = runSweep(tr, configs, n_threads,
+					   chunk_records, warmup);
+    runtime = timestamp() - runtime;
+    std::cerr << KGRN << "SWEEP: " << configs.size() << " configs on "
+	      << n_threads << " threads in " << runtime << " sec"
+	      << KNRM << "\n";
+    std::ofstream out(results);
+    writeSweep(out, configs, r);
+    return 0;
+  }
+
+  replay_ctx x;
+  x.rsb = new return_stack(rc, icnt);
+  for(const bpred_config &c : configs) {
+    x.predictors.add(c, icnt);
+  }
+  x.bpred = x.predictors[0];
+  x.predictors.set_indirect(ic, icnt);
+  if(vm.count("btb")) {
+    x.btb = new branch_target_buffer(bc, icnt);
+  }
+
+  double runtime = timestamp();
+  replay(x, tr, icnt);
+  runtime = timestamp() - runtime;
+
+  std::cerr << KGRN << "REPLAY: "
+	    << runtime << " sec, "
+	    << icnt << " ins replayed, "
+	    << (icnt/runtime)*1e-6 << "  megains / sec"
+	    << KNRM << "\n";
+
+  if(x.predictors.size() == 1) {
+    std::cerr << *(x.bpred) << "\n";
+  }
+  else {
+    std::cerr << x.predictors;
+  }
+
+  std::cerr << "num jr r31 = " << x.rsb->pops() << "\n";
+  std::cerr << "num mispredicted jr r31 = " << x.rsb->mispredicts()
+	    << "\n";
+  std::cerr << *x.rsb;
+
+  std::cerr << *x.predictors.indirect();
+  if(x.btb) {
+    std::cerr << *x.btb;
+  }
+
+  dump_histo("mispredicts.txt", x.bpred->getMap());
+  dump_histo("indirect_mispredicts.txt", x.predictors.indirect()->getMap());
+  dump_histo("rsb_mispredicts.txt", x.rsb->getMap());
+  if(x.btb) {
+    dump_histo("btb_mispredicts.txt", x.btb->getMap());
+  }
+
+  x.predictors.report(std::cout);
+  return 0;
+}
@@ -0,0 +1,64 @@
+#include <cstdlib>
+#include <sstream>
+#include "returnStack.hh"
+#include "helper.hh"
+
+#define PAIR(X) {#X, return_stack::rsb_policy::X},
+const std::map<std::string, return_stack::rsb_policy> return_stack::rsb_policy_map = {
+  RSB_POLICY_LIST(PAIR)
+};
+#undef PAIR
+
+bool rsb_config::parse(const std::string &spec) {
+  spec_pairs kvs;
+  if(not(splitSpec(spec, nullptr, kvs))) {
+    return false;
+  }
+  for(const auto &kv : kvs) {
+    const std::string &key = kv.first, &v = kv.second;
+    bool ok = true;
+    if(key == "depth") {
+      ok = parseNumber(v, depth);
+    }
+    else if(key == "policy") {
+      policy = v;
+    }
+    else if(key == "valid_bits") {
+      ok = parseNumber(v, valid_bits);
+    }
+    else {
+      return false;
+    }
+    if(not(ok)) {
+      return false;
+    }
+  }
+  return valid();
+}
+
+bool rsb_config::valid() const {
+  return (depth != 0) and (return_stack::rsb_policy_map.count(policy) != 0);
+}
+
+std::string rsb_config::str() const {
+  std::stringstream ss;
+  ss << "depth=" << depth
+     << ",policy=" << policy
+     << ",valid_bits=" << valid_bits;
+  return ss.str();
+}
+
+return_stack::return_stack(const rsb_config &c, uint64_t &icnt) :
+  cfg(c), policy(rsb_policy_map.at(c.policy)),
+  addrs(c.depth, 0), valid(c.depth, 0), tos(c.depth - 1), icnt(icnt) {}
+
+std::ostream &operator<<(std::ostream &out, const return_stack &r) {
+  out << "rsb : " << r.cfg.str() << "\n";
+  out << r.n_pushes << " pushes, " << r.n_pops << " pops, "
+      << r.n_overflows << " overflows, " << r.n_underflows << " underflows\n";
+  out << r.n_wrong_target << " wrong targets, "
+      << r.n_no_target << " pops with no target\n";
+  out << 1000.0 * (static_cast<double>(r.mispredicts()) / r.icnt)
+      << " return mispredicts per kilo insn\n";
+  return out;
+}
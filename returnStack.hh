@@ -0,0 +1,110 @@
+#ifndef __RETURN_STACK_HH__
+#define __RETURN_STACK_HH__
+
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#define RSB_POLICY_LIST(BA) \
+  BA(circular)		    \
+  BA(stack)
+
+/* return stack geometry, written as key=value[,key=value...] */
+struct rsb_config {
+  uint32_t depth = 4;
+  /* circular overwrites the oldest entry when full and pops wrap
+   * around when empty. stack drops calls when full and predicts
+   * nothing when empty */
+  std::string policy = "circular";
+  /* each entry is valid from its push to its pop, and an invalid
+   * entry predicts nothing */
+  bool valid_bits = false;
+  bool parse(const std::string &spec);
+  bool valid() const;
+  std::string str() const;
+};
+
+/* predicts jr $31 targets from the return addresses of earlier
+ * jal and jalr. wrong and missing predictions are charged to the
+ * call site that actually returned, i.e. the return target - 8 */
+class return_stack {
+public:
+#define ITEM(X) X,
+  enum class rsb_policy {
+    RSB_POLICY_LIST(ITEM)
+  };
+#undef ITEM
+  static const std::map<std::string, rsb_policy> rsb_policy_map;
+private:
+  rsb_config cfg;
+  rsb_policy policy;
+  std::vector<uint32_t> addrs;
+  std::vector<uint8_t> valid;
+  uint32_t tos, count = 0;
+  uint64_t &icnt;
+  uint64_t n_pushes = 0, n_pops = 0, n_overflows = 0, n_underflows = 0;
+  uint64_t n_wrong_target = 0, n_no_target = 0;
+  std::map<uint32_t, uint64_t> site_map;
+  void mispredict(uint32_t target, bool have_target) {
+    n_wrong_target += have_target;
+    n_no_target += not(have_target);
+    site_map[target - 8]++;
+  }
+public:
+  return_stack(const rsb_config &c, uint64_t &icnt);
+  void push(uint32_t ret_addr) {
+    n_pushes++;
+    if(count == cfg.depth) {
+      n_overflows++;
+      if(policy == rsb_policy::stack) {
+	return;
+      }
+    }
+    else {
+      count++;
+    }
+    addrs[tos] = ret_addr;
+    valid[tos] = 1;
+    tos = (tos == 0) ? (cfg.depth - 1) : (tos - 1);
+  }
+  /* pops the prediction for a return to target, true when it
+   * was right */
+  bool pop(uint32_t target) {
+    n_pops++;
+    if(count == 0) {
+      n_underflows++;
+      if(policy == rsb_policy::stack) {
+	mispredict(target, false);
+	return false;
+      }
+    }
+    else {
+      count--;
+    }
+    tos = (tos == (cfg.depth - 1)) ? 0 : (tos + 1);
+    if(cfg.valid_bits and not(valid[tos])) {
+      mispredict(target, false);
+      return false;
+    }
+    valid[tos] = 0;
+    if(addrs[tos] != target) {
+      mispredict(target, true);
+      return false;
+    }
+    return true;
+  }
+  uint64_t pops() const {
+    return n_pops;
+  }
+  uint64_t mispredicts() const {
+    return n_wrong_target + n_no_target;
+  }
+  const std::map<uint32_t, uint64_t> &getMap() const {
+    return site_map;
+  }
+  friend std::ostream &operator<<(std::ostream &, const return_stack &);
+};
+
+#endif
@@ -1,11 +1,104 @@
 #include <cstdio>
 #include <algorithm>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
 #include "simCache.hh"
 #include "helper.hh"
 #include "globals.hh"
 
 
 
+#define PAIR(X) {#X, cacheInclusion::X},
+const std::map<std::string, cacheInclusion> simCache::inclusion_map = {
+  CACHE_INCLUSION_LIST(PAIR)
+};
+#undef PAIR
+
+static const char *inclusion_name(cacheInclusion i) {
+#define NAME(X) case cacheInclusion::X: return #X;
+  switch(i)
+    {
+      CACHE_INCLUSION_LIST(NAME)
+    }
+#undef NAME
+  return "unknown";
+}
+
+bool cache_config::parse(const std::string &spec) {
+  spec_pairs kvs;
+  if(not(splitSpec(spec, nullptr, kvs))) {
+    return false;
+  }
+  for(const auto &kv : kvs) {
+    const std::string &key = kv.first, &v = kv.second;
+    bool ok = true;
+    if(key == "sets") {
+      ok = parseNumber(v, sets);
+    }
+    else if(key == "assoc") {
+      ok = parseNumber(v, assoc);
+    }
+    else if(key == "latency") {
+      ok = parseNumber(v, latency);
+    }
+    else if(key == "inclusion") {
+      inclusion = v;
+    }
+    else if(key == "write") {
+      ok = (v == "back") or (v == "through");
+      write_back = (v == "back");
+    }
+    else if(key == "write_allocate") {
+      ok = parseNumber(v, write_allocate);
+    }
+    else if(key == "repl") {
+      repl.policy = v;
+    }
+    else {
+      ok = repl.set(key, v);
+    }
+    if(not(ok)) {
+      return false;
+    }
+  }
+  return valid();
+}
+
+bool cache_config::valid() const {
+  if(sets == 0 or (sets & (sets - 1)) or assoc == 0 or (assoc & (assoc - 1))) {
+    return false;
+  }
+  if(simCache::inclusion_map.count(inclusion) == 0) {
+    return false;
+  }
+  return repl.valid() and (repl.policy != "opt");
+}
+
+std::string cache_config::str() const {
+  std::stringstream ss;
+  ss << "sets=" << sets
+     << ",assoc=" << assoc
+     << ",latency=" << latency
+     << ",inclusion=" << inclusion
+     << ",write=" << (write_back ? "back" : "through")
+     << ",write_allocate=" << write_allocate
+     << ",repl=" << repl.str();
+  return ss.str();
+}
+
+simCache *simCache::make(size_t bytes_per_line, size_t assoc, size_t num_sets,
+			 std::string name, int latency, simCache *next_level,
+			 const repl_config &rc) {
+  if(assoc == 1) {
+    return new directMappedCache(bytes_per_line, 1, num_sets, name, latency, next_level);
+  }
+  if(num_sets == 1) {
+    return new fullAssocCache(bytes_per_line, assoc, 1, name, latency, next_level, rc);
+  }
+  return new setAssocCache(bytes_per_line, assoc, num_sets, name, latency, next_level, rc);
+}
+
 std::ostream &operator<<(std::ostream &out, const simCache &cache) {
   double total = static_cast<double>(cache.hits+cache.misses);
   double rate = cache.misses / total;
@@ -15,6 +108,9 @@ std::ostream &operator<<(std::ostream &out, const simCache &cache) {
   out << "bytes_per_line = " << cache.bytes_per_line << "\n";
   out << "assoc = " << cache.assoc << "\n";
   out << "num_sets = " << cache.num_sets<< "\n";
+  if(cache.repl) {
+    out << "replacement = " << cache.repl->str() << "\n";
+  }
   out << "hit_rate = " << (1.0 - rate) << "\n";
   out << "total_access = " << (cache.hits+cache.misses)  << "\n";
   out << "hits = " << cache.hits << "\n";
@@ -23,6 +119,22 @@ std::ostream &operator<<(std::ostream &out, const simCache &cache) {
   out << "read_misses = "<< cache.rw_misses[0] << "\n";
   out << "write_hits = "<< cache.rw_hits[1] << "\n";
   out << "write_misses = "<< cache.rw_misses[1] << "\n";
+  out << "write_policy = " << (cache.write_back ? "back" : "through")
+      << (cache.write_allocate ? ",allocate" : ",no_allocate") << "\n";
+  out << "writebacks = " << cache.writebacks << "\n";
+  out << "fill_bytes = " << cache.fill_bytes << "\n";
+  out << "writeback_bytes = " << cache.writebacks * cache.bytes_per_line << "\n";
+  out << "write_through_bytes = " << cache.write_through_bytes << "\n";
+  out << "traffic_bytes = " << (cache.fill_bytes + cache.writebacks * cache.bytes_per_line +
+				cache.write_through_bytes) << "\n";
+  if(cache.next_level or cache.prev_level) {
+    out << "inclusion = " << inclusion_name(cache.inclusion) << "\n";
+    out << "evictions = " << cache.evictions << "\n";
+    out << "victim_fills = " << cache.victim_fills << "\n";
+    out << "back_invalidations = " << cache.back_invalidations << "\n";
+    out << "latency = " << cache.latency << "\n";
+    out << "amat = " << cache.computeAMAT() << "\n";
+  }
 
   if(globals::enableStackDepth) {
     for(size_t i = 0; i < cache.max_stack_size; i++) {
@@ -65,6 +177,10 @@ simCache::simCache(size_t bytes_per_line, size_t assoc, size_t num_sets,
   ln2_offset_bits = ln2_num_sets + ln2_bytes_per_line;
   ln2_tag_bits = 8*sizeof(uint32_t) - ln2_offset_bits;
 
+  if(next_level) {
+    next_level->prev_level = this;
+  }
+
   if(globals::enableStackDepth) {
     max_stack_size = num_sets*assoc*4;
     stack_hits.resize(max_stack_size);
@@ -72,7 +188,185 @@ simCache::simCache(size_t bytes_per_line, size_t assoc, size_t num_sets,
   }
 }
 
-simCache::~simCache() {}
+simCache::~simCache() {
+  if(trace_fp) {
+    drain_trace();
+    fclose(trace_fp);
+  }
+  delete repl;
+  delete next_level;
+}
+
+bool simCache::reference(uint32_t addr, uint32_t num_bytes, opType o) {
+  const bool write = (opType::WRITE==o);
+  const bool keep_dirty = write and write_back;
+  const bool exclusive = prev_level and (inclusion == cacheInclusion::exclusive);
+  /* lines leave an exclusive level for the one that missed. a
+   * write is a write through from above, which either holds the
+   * line already or did not allocate it, so it stays put and never
+   * allocates here */
+  const bool moves_up = exclusive and not(write);
+  const bool allocate = not(write) or (write_allocate and not(exclusive));
+  bool dirty = false;
+  bool hit = lookup(addr, keep_dirty);
+  if(hit) {
+    hits++;
+    rw_hits[write ? 1 : 0]++;
+    if(moves_up) {
+      invalidate(addr, dirty);
+    }
+  }
+  else {
+    misses++;
+    rw_misses[write ? 1 : 0]++;
+    if(allocate) {
+      fill_bytes += bytes_per_line;
+      if(next_level) {
+	dirty = next_level->reference(addr, bytes_per_line, opType::READ);
+      }
+      /* a dirty line from an exclusive level goes on down as a
+       * write through, which allocates in no exclusive level */
+      if(dirty and not(write_back)) {
+	write_through(addr, bytes_per_line);
+	dirty = false;
+      }
+      if(not(moves_up)) {
+	install(addr, dirty or keep_dirty);
+	dirty = false;
+      }
+      else if(repl) {
+	repl->skip(addr >> ln2_bytes_per_line);
+      }
+    }
+    else if(repl) {
+      repl->skip(addr >> ln2_bytes_per_line);
+    }
+  }
+  /* a write that misses without allocating goes on like a
+   * write-through one */
+  if(write and (not(write_back) or not(hit or allocate))) {
+    write_through(addr, num_bytes);
+  }
+  if(globals::enableStackDepth) {
+    update_distance_stack(addr, hit);
+  }
+  return dirty;
+}
+
+void simCache::install(uint32_t addr, bool dirty) {
+  uint32_t victim;
+  bool victim_dirty;
+  if(insert(addr, dirty, victim, victim_dirty)) {
+    evictions++;
+    evict(victim, victim_dirty);
+  }
+}
+
+void simCache::evict(uint32_t victim, bool dirty) {
+  /* a dirty copy above is newer than this one */
+  if(prev_level and (inclusion == cacheInclusion::inclusive)) {
+    dirty |= prev_level->back_invalidate(victim);
+  }
+  if(dirty) {
+    write_back_line(victim);
+  }
+  else if(next_level and (next_level->inclusion == cacheInclusion::exclusive)) {
+    next_level->victim_fills++;
+    next_level->install(victim, false);
+  }
+}
+
+bool simCache::back_invalidate(uint32_t addr) {
+  bool dirty = false;
+  back_invalidations += invalidate(addr, dirty);
+  if(prev_level) {
+    dirty |= prev_level->back_invalidate(addr);
+  }
+  return dirty;
+}
+
+/* a dirty line leaving for the next level or memory */
+void simCache::write_back_line(uint32_t addr) {
+  writebacks++;
+  if(next_level == nullptr) {
+    return;
+  }
+  if(next_level->inclusion == cacheInclusion::exclusive) {
+    /* a line a nine level passed on may still be there as a clean
+     * victim of that level */
+    if(not(next_level->lookup(addr, true))) {
+      next_level->victim_fills++;
+      next_level->install(addr, true);
+    }
+  }
+  else {
+    next_level->receive_writeback(addr);
+  }
+}
+
+void simCache::write_through(uint32_t addr, uint32_t num_bytes) {
+  write_through_bytes += num_bytes;
+  if(next_level) {
+    next_level->reference(addr, num_bytes, opType::WRITE);
+  }
+}
+
+/* a whole dirty line from the level above, which needs no fill.
+ * only one of this level and an exclusive one below may keep it:
+ * allocating here pulls the copy out from below, and passing it
+ * down drops the copy here */
+void simCache::receive_writeback(uint32_t addr) {
+  const bool below_exclusive = next_level and
+    (next_level->inclusion == cacheInclusion::exclusive);
+  bool dirty = false;
+  if(write_back) {
+    if(lookup(addr, true)) {
+      return;
+    }
+    if(write_allocate) {
+      if(below_exclusive) {
+	next_level->invalidate(addr, dirty);
+      }
+      install(addr, true);
+      return;
+    }
+  }
+  else if(below_exclusive) {
+    invalidate(addr, dirty);
+  }
+  else {
+    lookup(addr, false);
+  }
+  write_back_line(addr);
+}
+
+void simCache::set_trace(const std::string &fname) {
+  trace_fp = fopen(fname.c_str(), "wb");
+  if(trace_fp == nullptr) {
+    std::cerr << KRED << "unable to open memory trace " << fname << KNRM << "\n";
+    exit(-1);
+  }
+  const uint32_t hdr[2] = {opt_policy::trace_magic, opt_policy::trace_version};
+  if(fwrite(hdr, sizeof(hdr), 1, trace_fp) != 1) {
+    die();
+  }
+  trace_buf.reserve(1UL<<18);
+}
+
+void simCache::record_trace(uint32_t addr) {
+  if(trace_buf.size() == trace_buf.capacity()) {
+    drain_trace();
+  }
+  trace_buf.push_back(addr);
+}
+
+void simCache::drain_trace() {
+  if(fwrite(trace_buf.data(), sizeof(uint32_t), trace_buf.size(), trace_fp) != trace_buf.size()) {
+    std::cerr << KRED << "short write to memory trace" << KNRM << "\n";
+    exit(-1);
+  }
+  trace_buf.clear();
+}
 
 
 void simCache::update_distance_stack(uint32_t addr, bool hit) {
@@ -100,6 +394,9 @@ void simCache::update_distance_stack(uint32_t addr, bool hit) {
 
 void simCache::set_next_level(simCache *next_level) {
   this->next_level = next_level;
+  if(next_level) {
+    next_level->prev_level = this;
+  }
 }
 
 uint32_t simCache::index(uint32_t addr, uint32_t &l, uint32_t &t) {
@@ -123,6 +420,7 @@ directMappedCache::directMappedCache(size_t bytes_per_line, size_t assoc, size_t
   assert(assoc == 1);
   tags.resize(num_sets);
   valid.resize(num_sets, false);
+  dirty.resize(num_sets, false);
 
 
   
@@ -131,35 +429,73 @@ directMappedCache::directMappedCache(size_t bytes_per_line, size_t assoc, size_t
 directMappedCache::~directMappedCache(){}
 
 void directMappedCache::flush() {
+  for(size_t w = 0; w < num_sets; w++) {
+    if(valid[w] and dirty[w]) {
+      write_back_line((tags[w] << ln2_offset_bits) | (w << ln2_bytes_per_line));
+    }
+  }
   valid.reset();
+  dirty.reset();
 }
 
-void directMappedCache::access(uint32_t addr, uint32_t num_bytes, opType o) {
+bool directMappedCache::lookup(uint32_t addr, bool dirty) {
   uint32_t w,t;
-  uint32_t b = index(addr, w, t);
-
-  bool hit = false;
+  index(addr, w, t);
   if(tags[w]==t && valid[w]) {
-    hits++;
-    rw_hits[(opType::WRITE==o) ? 1 : 0]++;
-    hit = true;
-  }
-  else {
-    misses++;
-    rw_misses[(opType::WRITE==o) ? 1 : 0]++;
-    valid[w] = true;
-    tags[w] = t;
-    hit = false;
+    this->dirty[w] |= dirty;
+    return true;
   }
+  return false;
+}
 
-  if(globals::enableStackDepth) {
-    update_distance_stack(addr,hit);
+bool directMappedCache::insert(uint32_t addr, bool dirty, uint32_t &victim, bool &victim_dirty) {
+  uint32_t w,t;
+  index(addr, w, t);
+  assert(not(valid[w] and tags[w] == t));
+  bool evict = valid[w];
+  victim = (tags[w] << ln2_offset_bits) | (w << ln2_bytes_per_line);
+  victim_dirty = this->dirty[w];
+  valid[w] = true;
+  this->dirty[w] = dirty;
+  tags[w] = t;
+  return evict;
+}
+
+bool directMappedCache::invalidate(uint32_t addr, bool &dirty) {
+  uint32_t w,t;
+  index(addr, w, t);
+  if(not(tags[w]==t && valid[w])) {
+    return false;
   }
-  
+  dirty = this->dirty[w];
+  valid[w] = false;
+  this->dirty[w] = false;
+  return true;
+}
+
+fullAssocCache::fullAssocCache(size_t bytes_per_line, size_t assoc, size_t num_sets, 
+			       std::string name, int latency, simCache *next_level,
+			       const repl_config &rc) :
+  simCache(bytes_per_line, assoc, num_sets, name, latency, next_level),
+  hitdepth(assoc, 0), tags(assoc, 0), dirty(assoc, 0) {
+  repl = replacement_policy::make(rc, assoc, 1, ln2_bytes_per_line);
+  flush();
 }
 
 void fullAssocCache::flush() {
+  for(const auto &tw : ways) {
+    if(dirty[tw.second]) {
+      write_back_line(tw.first << ln2_offset_bits);
+      dirty[tw.second] = 0;
+    }
+  }
   entries.clear();
+  ways.clear();
+  free_ways.clear();
+  for(size_t w = assoc; w != 0; w--) {
+    free_ways.push_back(w - 1);
+  }
+  repl->flush();
 }
 
 fullAssocCache::~fullAssocCache() {
@@ -168,64 +504,175 @@ fullAssocCache::~fullAssocCache() {
   }
 }
 
-
-void fullAssocCache::access(uint32_t addr, uint32_t num_bytes, opType o) {
+bool fullAssocCache::lookup(uint32_t addr, bool dirty) {
   uint32_t w,t;
-  uint32_t b = index(addr, w, t);
-  bool hit = false;
+  index(addr, w, t);
   auto it = entries.find(t);
-  if(it != entries.end()) {
-    hits++;
-    auto d = entries.distance(it);
-    hitdepth[d]++;
-    rw_hits[(opType::WRITE==o) ? 1 : 0]++;
-    entries.move_to_head(it);
-    hit = true;
+  if(it == entries.end()) {
+    return false;
+  }
+  hitdepth[entries.distance(it)]++;
+  entries.move_to_head(it);
+  size_t v = ways[t];
+  this->dirty[v] |= dirty;
+  repl->hit(0, v, t);
+  return true;
+}
+
+bool fullAssocCache::insert(uint32_t addr, bool dirty, uint32_t &victim, bool &victim_dirty) {
+  uint32_t w,t;
+  index(addr, w, t);
+  assert(ways.find(t) == ways.end());
+  bool evict = free_ways.empty();
+  size_t v;
+  if(evict) {
+    v = repl->victim(0);
+    victim = tags[v] << ln2_offset_bits;
+    victim_dirty = this->dirty[v];
+    entries.erase(entries.find(tags[v]));
+    ways.erase(tags[v]);
   }
   else {
-    misses++;
-    rw_misses[(opType::WRITE==o) ? 1 : 0]++;
-    if(entries.size() == assoc) {
-      entries.pop_back();
-    }
-    entries.push_front(t);
+    v = free_ways.back();
+    free_ways.pop_back();
   }
-  if(globals::enableStackDepth) {
-    update_distance_stack(addr, hit);
+  entries.push_front(t);
+  tags[v] = t;
+  this->dirty[v] = dirty;
+  ways[t] = v;
+  repl->fill(0, v, t);
+  return evict;
+}
+
+bool fullAssocCache::invalidate(uint32_t addr, bool &dirty) {
+  uint32_t w,t;
+  index(addr, w, t);
+  auto it = ways.find(t);
+  if(it == ways.end()) {
+    return false;
   }
+  dirty = this->dirty[it->second];
+  this->dirty[it->second] = 0;
+  free_ways.push_back(it->second);
+  entries.erase(entries.find(t));
+  ways.erase(it);
+  return true;
 }
 
+const uint32_t setAssocCache::invalid_tag;
+
 setAssocCache::setAssocCache(size_t bytes_per_line, size_t assoc, size_t num_sets, 
-			     std::string name, int latency, simCache *next_level) :
+			     std::string name, int latency, simCache *next_level,
+			     const repl_config &rc) :
   simCache(bytes_per_line, assoc, num_sets, name, latency, next_level) {
-  sets = new cacheset*[num_sets];
-  for(size_t i = 0; i < num_sets; ++i) {
-    sets[i] = new cacheset(i,assoc,hits,misses,rw_hits,rw_misses);
+  if(ln2_offset_bits == 0) {
+    std::cerr << "setAssocCache : a tag of ~0 marks an invalid way, so lines or sets must be > 1\n";
+    die();
   }
+  tags.assign(num_sets * assoc, invalid_tag);
+  dirty.assign(num_sets * assoc, 0);
+  repl = replacement_policy::make(rc, assoc, num_sets, ln2_bytes_per_line);
 }
+
 setAssocCache::~setAssocCache() {
   size_t cap = 0;
-  for(size_t i = 0; i < num_sets; ++i) {
-    cap += bytes_per_line * sets[i]->size();
-    delete sets[i];
+  for(uint32_t t : tags) {
+    cap += (t != invalid_tag) ? bytes_per_line : 0;
   }
-  delete [] sets;
   print_var(cap);
 }
 
 void setAssocCache::flush() {
-  for(size_t i = 0; i < num_sets; ++i) {
-    sets[i]->clear();
+  for(size_t i = 0; i < tags.size(); i++) {
+    if((tags[i] != invalid_tag) and dirty[i]) {
+      const uint32_t l = i / assoc;
+      write_back_line((tags[i] << ln2_offset_bits) | (l << ln2_bytes_per_line));
+    }
   }
+  std::fill(tags.begin(), tags.end(), invalid_tag);
+  std::fill(dirty.begin(), dirty.end(), 0);
+  repl->flush();
 }
 
-void setAssocCache::access(uint32_t addr, uint32_t num_bytes, opType o) {
-  uint32_t w,t;
-  uint32_t b = index(addr, w, t);
-  bool hit = sets[w]->access(t,o);
-  if(globals::enableStackDepth) {
-    update_distance_stack(addr, hit);
+/* bit i set where tags[i] == t, for n <= 64 tags */
+static inline uint64_t match_tags(const uint32_t *tags, size_t n, uint32_t t) {
+  uint64_t m = 0;
+  size_t i = 0;
+#ifdef __AVX2__
+  const __m256i t8 = _mm256_set1_epi32(t);
+  for(; (i + 8) <= n; i += 8) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(tags + i));
+    uint32_t b = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(v, t8)));
+    m |= static_cast<uint64_t>(b) << i;
   }
+#endif
+#ifdef __SSE2__
+  const __m128i t4 = _mm_set1_epi32(t);
+  for(; (i + 4) <= n; i += 4) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(tags + i));
+    uint32_t b = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(v, t4)));
+    m |= static_cast<uint64_t>(b) << i;
+  }
+#endif
+  for(; i < n; i++) {
+    m |= static_cast<uint64_t>(tags[i] == t) << i;
+  }
+  return m;
+}
+
+/* the way of set l holding tag t, or -1 */
+ssize_t setAssocCache::find(uint32_t l, uint32_t t) const {
+  const size_t base = l * assoc;
+  for(size_t w = 0; w < assoc; w += 64) {
+    uint64_t m = match_tags(&tags[base + w], std::min<size_t>(64, assoc - w), t);
+    if(m) {
+      return w + __builtin_ctzll(m);
+    }
+  }
+  return -1;
+}
+
+bool setAssocCache::lookup(uint32_t addr, bool dirty) {
+  uint32_t l,t;
+  index(addr, l, t);
+  ssize_t w = find(l, t);
+  if(w < 0) {
+    return false;
+  }
+  this->dirty[l * assoc + w] |= dirty;
+  repl->hit(l, w, addr >> ln2_bytes_per_line);
+  return true;
+}
+
+bool setAssocCache::insert(uint32_t addr, bool dirty, uint32_t &victim, bool &victim_dirty) {
+  uint32_t l,t;
+  index(addr, l, t);
+  assert(find(l, t) < 0);
+  /* ways fill in order before anything is evicted */
+  ssize_t w = find(l, invalid_tag);
+  bool evict = (w < 0);
+  if(evict) {
+    w = repl->victim(l);
+    victim = (tags[l * assoc + w] << ln2_offset_bits) | (l << ln2_bytes_per_line);
+    victim_dirty = this->dirty[l * assoc + w];
+  }
+  tags[l * assoc + w] = t;
+  this->dirty[l * assoc + w] = dirty;
+  repl->fill(l, w, addr >> ln2_bytes_per_line);
+  return evict;
+}
+
+bool setAssocCache::invalidate(uint32_t addr, bool &dirty) {
+  uint32_t l,t;
+  index(addr, l, t);
+  ssize_t w = find(l, t);
+  if(w < 0) {
+    return false;
+  }
+  dirty = this->dirty[l * assoc + w];
+  this->dirty[l * assoc + w] = 0;
+  tags[l * assoc + w] = invalid_tag;
+  return true;
 }
 
 
@@ -233,11 +680,17 @@ void setAssocCache::access(uint32_t addr, uint32_t num_bytes, opType o) {
 
 void simCache::read(uint32_t addr, uint32_t num_bytes)
 {
+  if(trace_fp) {
+    record_trace(addr);
+  }
   access(addr,num_bytes,opType::READ);
 }
 
 void simCache::write(uint32_t addr, uint32_t num_bytes)
 {
+  if(trace_fp) {
+    record_trace(addr);
+  }
   access(addr,num_bytes,opType::WRITE);
 }
 
@@ -293,10 +746,10 @@ std::string simCache::getStats(std::string &fName) {
 }
 
 
-double simCache::computeAMAT() {
+double simCache::computeAMAT() const {
   size_t total = hits+misses;
-  double rate = ((double)misses) / ((double)total);
-  double nextLevelLat = 100.0;
+  double rate = (total == 0) ? 0.0 : ((double)misses) / ((double)total);
+  double nextLevelLat = mem_latency;
   if(next_level)
     nextLevelLat = next_level->computeAMAT();
   
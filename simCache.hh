@@ -1,5 +1,6 @@
 #ifndef __SIM_CACHE_H__
 #define __SIM_CACHE_H__
+#include <cstdio>
 #include <string>
 #include <sstream>
 #include <cstdlib>
@@ -9,14 +10,52 @@
 #include <cassert>
 #include <cstdint>
 #include <array>
+#include <map>
 #include <list>
 #include <unordered_set>
 #include <boost/dynamic_bitset.hpp>
 
+#include <unordered_map>
 #include "mylist.hh"
+#include "replacementPolicy.hh"
 
 enum class opType {READ,WRITE};
 
+#define CACHE_INCLUSION_LIST(BA) \
+  BA(nine)			 \
+  BA(inclusive)			 \
+  BA(exclusive)
+
+#define ITEM(X) X,
+/* what a level holds of the lines in the levels above it.
+ * nine (non-inclusive non-exclusive) fills on every miss and
+ * evicts freely. inclusive also invalidates its victims above.
+ * exclusive only takes the victims of the level above, and a
+ * line moves up out of it on a hit */
+enum class cacheInclusion {
+  CACHE_INCLUSION_LIST(ITEM)
+};
+#undef ITEM
+
+/* a cache level below l1d, written as key=value[,...], e.g.
+ * "sets=512,assoc=8,latency=12,inclusion=exclusive,repl=drrip".
+ * other keys go to its replacement policy, which can't be opt
+ * as only l1d records memory traces */
+struct cache_config {
+  uint32_t sets = 512;
+  uint32_t assoc = 8;
+  int latency = 12;
+  std::string inclusion = "nine";
+  /* write=back keeps dirty lines, write=through sends every
+   * store on to the next level */
+  bool write_back = true;
+  bool write_allocate = true;
+  repl_config repl;
+  bool parse(const std::string &spec);
+  bool valid() const;
+  std::string str() const;
+};
+
 #ifndef print_var
 #define print_var(x) { std::cout << #x << " = " << x << "\n"; }
 #endif
@@ -30,7 +69,18 @@ protected:
   std::string name;
   int latency;
   simCache *next_level;
+  /* the level whose misses come here, for back-invalidation */
+  simCache *prev_level = nullptr;
+  cacheInclusion inclusion = cacheInclusion::nine;
+  /* only the last level uses it, for its misses */
+  int mem_latency = 100;
   size_t hits,misses;
+  /* valid lines replaced here, victims of the level above put
+   * here (exclusive) and lines lost to an inclusive level below */
+  size_t evictions = 0, victim_fills = 0, back_invalidations = 0;
+  /* write policy and the traffic it sends to the next level */
+  bool write_back = true, write_allocate = true;
+  size_t writebacks = 0, fill_bytes = 0, write_through_bytes = 0;
   
   size_t total_cache_size = 0;
   size_t ln2_tag_bits = 0;
@@ -46,6 +96,40 @@ protected:
   mylist<uint32_t> stack;
   std::vector<uint64_t> stack_hits, stack_misses;
   void update_distance_stack(uint32_t addr, bool hit);
+
+  /* victim selection of the associative caches */
+  replacement_policy *repl = nullptr;
+
+  /* a real cache implements these. lookup updates replacement
+   * state on a hit and marks the line dirty if asked to. insert
+   * fills the line of addr and returns true with the address and
+   * dirty bit of a valid line it evicted, and invalidate returns
+   * true with the dirty bit if the line was there */
+  virtual bool lookup(uint32_t addr, bool dirty) {
+    return false;
+  }
+  virtual bool insert(uint32_t addr, bool dirty, uint32_t &victim, bool &victim_dirty) {
+    return false;
+  }
+  virtual bool invalidate(uint32_t addr, bool &dirty) {
+    return false;
+  }
+  /* moves lines through the hierarchy's inclusion and write
+   * rules. reference returns true when the line leaves an
+   * exclusive level dirty on its way up */
+  bool reference(uint32_t addr, uint32_t num_bytes, opType o);
+  void install(uint32_t addr, bool dirty);
+  void evict(uint32_t victim, bool dirty);
+  bool back_invalidate(uint32_t addr);
+  void write_back_line(uint32_t addr);
+  void write_through(uint32_t addr, uint32_t num_bytes);
+  void receive_writeback(uint32_t addr);
+
+  /* every address accessed, for a later opt run */
+  FILE *trace_fp = nullptr;
+  std::vector<uint32_t> trace_buf;
+  void record_trace(uint32_t addr);
+  void drain_trace();
   
 public:
   friend std::ostream &operator<<(std::ostream &out, const simCache &cache);
@@ -54,6 +138,27 @@ public:
   virtual ~simCache();
   
   void set_next_level(simCache *next_level);
+  simCache *get_next_level() const {
+    return next_level;
+  }
+  void set_inclusion(cacheInclusion inclusion) {
+    this->inclusion = inclusion;
+  }
+  void set_write_policy(bool write_back, bool write_allocate) {
+    this->write_back = write_back;
+    this->write_allocate = write_allocate;
+  }
+  void set_mem_latency(int mem_latency) {
+    this->mem_latency = mem_latency;
+  }
+  static const std::map<std::string, cacheInclusion> inclusion_map;
+  /* a direct-mapped, fully or set-associative cache for assoc and
+   * num_sets, which owns the levels below it */
+  static simCache *make(size_t bytes_per_line, size_t assoc, size_t num_sets,
+			std::string name, int latency, simCache *next_level,
+			const repl_config &rc);
+  /* writes a memory trace of this cache's accesses to fname */
+  void set_trace(const std::string &fname);
   
   uint32_t index(uint32_t addr, uint32_t &l, uint32_t &t);
   virtual void access(uint32_t addr, uint32_t num_bytes, opType o) {return;}
@@ -71,7 +176,7 @@ public:
   
   std::string getStats(std::string &fName);
   void getStats();
-  double computeAMAT();
+  double computeAMAT() const;
 
 };
 
@@ -81,87 +186,65 @@ std::ostream &operator<<(std::ostream &out, const simCache &cache);
 class directMappedCache : public simCache {
 private:
   std::vector<uint32_t> tags;
-  boost::dynamic_bitset<> valid;
+  boost::dynamic_bitset<> valid, dirty;
   void flush() override;
+  bool lookup(uint32_t addr, bool dirty) override;
+  bool insert(uint32_t addr, bool dirty, uint32_t &victim, bool &victim_dirty) override;
+  bool invalidate(uint32_t addr, bool &dirty) override;
 public:
   directMappedCache(size_t bytes_per_line, size_t assoc, size_t num_sets,
 		    std::string name, int latency, simCache *next_level);
   ~directMappedCache();
-  void access(uint32_t addr, uint32_t num_bytes, opType o) override;
+  void access(uint32_t addr, uint32_t num_bytes, opType o) override {
+    reference(addr, num_bytes, o);
+  }
 };
 
 class fullAssocCache: public simCache {
  private:
+  /* resident lines, most recently used first, for hitdepth */
   mylist<uint32_t> entries;
   std::vector<uint64_t> hitdepth;
+  /* the line in every way and the way of every line */
+  std::vector<uint32_t> tags;
+  std::vector<uint8_t> dirty;
+  std::unordered_map<uint32_t, size_t> ways;
+  /* ways emptied by a flush or invalidation, filled last first */
+  std::vector<size_t> free_ways;
+  bool lookup(uint32_t addr, bool dirty) override;
+  bool insert(uint32_t addr, bool dirty, uint32_t &victim, bool &victim_dirty) override;
+  bool invalidate(uint32_t addr, bool &dirty) override;
 public:
   fullAssocCache(size_t bytes_per_line, size_t assoc, size_t num_sets, 
-		std::string name, int latency, simCache *next_level) :
-    simCache(bytes_per_line, assoc, num_sets, name, latency, next_level) {
-    hitdepth.resize(assoc);
-    std::fill(hitdepth.begin(), hitdepth.end(), 0);
-  }
+		 std::string name, int latency, simCache *next_level,
+		 const repl_config &rc);
   ~fullAssocCache();
-  void access(uint32_t addr, uint32_t num_bytes, opType o) override;
+  void access(uint32_t addr, uint32_t num_bytes, opType o) override {
+    reference(addr, num_bytes, o);
+  }
   void flush() override;
 };
 
 
 class setAssocCache: public simCache {
  private:
-  class cacheset {
-  private:
-    int32_t id;
-    size_t assoc;
-    std::array<size_t,2> &rw_hits;
-    std::array<size_t,2> &rw_misses;
-    size_t &hits;
-    size_t &misses;
-    size_t lhits,lmisses;
-    mylist<uint32_t> entries;
-  public:
-    cacheset(int32_t id, size_t assoc,
-	     size_t &hits, size_t &misses,
-	     std::array<size_t, 2> &rw_hits,
-	     std::array<size_t, 2> &rw_misses) :
-      id(id), assoc(assoc), hits(hits), misses(misses),
-      rw_hits(rw_hits), rw_misses(rw_misses),
-      lhits(0), lmisses(0) {
-    }
-    bool access(uint32_t tag, opType o) {
-      auto it = entries.find(tag);
-      if(it != entries.end()) {
-	rw_hits[(opType::WRITE==o) ? 1 : 0]++;
-	hits++;
-	lhits++;
-	entries.move_to_head(it);
-	return true;
-      }
-      else {
-	rw_misses[(opType::WRITE==o) ? 1 : 0]++;
-	misses++;
-	lmisses++;
-    	if(entries.size() == assoc) {
-	  entries.pop_back();
-	}
-	entries.push_front(tag);
-	return false;
-      }
-    }
-    size_t size() const {
-      return entries.size();
-    }
-    void clear() {
-      entries.clear();
-    }
-  };
-  cacheset **sets;
-  
+  /* the tag and dirty bit of every way, way w of set l at
+   * l*assoc + w */
+  static const uint32_t invalid_tag = ~0U;
+  std::vector<uint32_t> tags;
+  std::vector<uint8_t> dirty;
+  ssize_t find(uint32_t l, uint32_t t) const;
+  bool lookup(uint32_t addr, bool dirty) override;
+  bool insert(uint32_t addr, bool dirty, uint32_t &victim, bool &victim_dirty) override;
+  bool invalidate(uint32_t addr, bool &dirty) override;
 public:
   setAssocCache(size_t bytes_per_line, size_t assoc, size_t num_sets, 
-		std::string name, int latency, simCache *next_level);
+		std::string name, int latency, simCache *next_level,
+		const repl_config &rc);
   ~setAssocCache();
-  void access(uint32_t addr, uint32_t num_bytes, opType o) override;
+  void access(uint32_t addr, uint32_t num_bytes, opType o) override {
+    reference(addr, num_bytes, o);
+  }
   void flush() override;
 };
 
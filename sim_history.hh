@@ -0,0 +1,139 @@
+#ifndef __sim_history_hh__
+#define __sim_history_hh__
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/* the newest len bits of a history xor-folded down to width
+ * bits, kept up to date in O(1) per shift (Seznec's circular
+ * shift register). bit i of the history lands on bit
+ * (i % width) of the fold */
+class folded_history {
+private:
+  uint64_t comp = 0, mask = 0;
+  uint32_t len = 0, width = 0, outpoint = 0;
+public:
+  folded_history(uint32_t len, uint32_t width) :
+    mask((1UL << width) - 1), len(len), width(width), outpoint(len % width) {}
+  uint32_t length() const {
+    return len;
+  }
+  uint64_t value() const {
+    return comp;
+  }
+  /* in is the bit just shifted in, out is the one that just
+   * left the window, i.e. history bit len after the shift */
+  void update(bool in, bool out) {
+    comp = (comp << 1) | static_cast<uint64_t>(in);
+    comp ^= static_cast<uint64_t>(out) << outpoint;
+    comp ^= comp >> width;
+    comp &= mask;
+  }
+  void clear() {
+    comp = 0;
+  }
+};
+
+/* global branch history plus any number of folded views of it.
+ * bit 0 is the newest outcome. bits live in a ring of words with
+ * the newest at head, so a push writes one bit and moves head
+ * back instead of shifting every word */
+class sim_history {
+private:
+  static const uint64_t bpw = 64;
+  uint64_t n_bits;
+  /* ring size in bits, a power of two and at least one word */
+  uint64_t cap = 0;
+  uint64_t head = 0;
+  std::vector<uint64_t> ring;
+  std::vector<folded_history> folds;
+  void resize(uint64_t min_bits) {
+    cap = bpw;
+    while(cap < min_bits) {
+      cap <<= 1;
+    }
+    ring.assign(cap / bpw, 0);
+    head = 0;
+  }
+public:
+  sim_history(uint64_t n_bits = 64) : n_bits(n_bits) {
+    resize(n_bits);
+  }
+  /* registers a fold of the newest len bits (all of them when
+   * len is 0) into width bits, width < 64. call before the
+   * first push; returns the handle for fold() */
+  size_t add_fold(uint32_t len, uint32_t width) {
+    len = (len == 0) ? n_bits : len;
+    if((len + 1) > cap) {
+      resize(len + 1);
+    }
+    folds.emplace_back(len, width);
+    return folds.size() - 1;
+  }
+  uint64_t fold(size_t i) const {
+    return folds[i].value();
+  }
+  bool get_bit(uint64_t i) const {
+    uint64_t p = (head + i) & (cap - 1);
+    return (ring[p / bpw] >> (p % bpw)) & 1;
+  }
+  bool operator[](uint64_t i) const {
+    return get_bit(i);
+  }
+  /* history bits i to i+63, bit i in bit 0 */
+  uint64_t window(uint64_t i) const {
+    uint64_t p = (head + i) & (cap - 1);
+    uint64_t w = p / bpw, off = p % bpw;
+    uint64_t v = ring[w] >> off;
+    if(off) {
+      v |= ring[(w + 1) & (ring.size() - 1)] << (bpw - off);
+    }
+    return v;
+  }
+  /* the newest k <= 64 bits, newest in bit 0 */
+  uint64_t recent(uint32_t k = 64) const {
+    uint64_t v = window(0);
+    return (k >= bpw) ? v : (v & ((1UL << k) - 1));
+  }
+  void push(bool taken) {
+    head = (head - 1) & (cap - 1);
+    uint64_t &w = ring[head / bpw];
+    uint64_t m = 1UL << (head % bpw);
+    w = taken ? (w | m) : (w & ~m);
+    /* folds of one length sit together, so each outgoing bit
+     * is read once */
+    uint32_t len = 0;
+    bool out = false;
+    for(folded_history &f : folds) {
+      if(f.length() != len) {
+	len = f.length();
+	out = get_bit(len);
+      }
+      f.update(taken, out);
+    }
+  }
+  void clear() {
+    std::fill(ring.begin(), ring.end(), 0);
+    for(folded_history &f : folds) {
+      f.clear();
+    }
+  }
+  size_t size() const {
+    return static_cast<size_t>(n_bits);
+  }
+  /* oldest first, like sim_bitvec::as_string */
+  std::string as_string() const {
+    std::string s;
+    for(int64_t i = (n_bits-1); i >= 0; i--) {
+      s += get_bit(i) ? "1" : "0";
+    }
+    return s;
+  }
+  uint64_t to_integer() const {
+    return recent(64);
+  }
+};
+
+#endif
@@ -0,0 +1,97 @@
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "simulation.hh"
+#include "simCache.hh"
+#include "branchTrace.hh"
+#include "branchTargetBuffer.hh"
+#include "returnStack.hh"
+
+simulation::simulation() {}
+
+simulation::~simulation() {
+  if(state) {
+    if(state->mem) {
+      munmap(state->mem, 1UL<<32);
+    }
+    free(state);
+  }
+  if(sysArgv) {
+    for(int i = 0; i < sysArgc; i++) {
+      delete [] sysArgv[i];
+    }
+    delete [] sysArgv;
+  }
+  delete rsb;
+  delete btb;
+  delete L1D;
+  delete trace;
+}
+
+bool simulation::init(uint64_t maxicnt) {
+  size_t pgSize = getpagesize();
+  if(posix_memalign((void**)&state, pgSize, pgSize) != 0) {
+    state = nullptr;
+    return false;
+  }
+  initState(state);
+  state->sim = this;
+  state->maxicnt = maxicnt;
+#ifdef __linux__
+  void* mempt = mmap(nullptr, 1UL<<32, PROT_READ | PROT_WRITE,
+		     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+#else
+  void* mempt = mmap(nullptr, 1UL<<32, PROT_READ | PROT_WRITE,
+		     MAP_PRIVATE | MAP_ANONYMOUS , -1, 0);
+#endif
+  if(mempt == reinterpret_cast<void*>(-1)) {
+    return false;
+  }
+  assert(madvise(mempt, 1UL<<32, MADV_DONTNEED)==0);
+  state->mem = reinterpret_cast<uint8_t*>(mempt);
+  return true;
+}
+
+void simulation::setRSB(const rsb_config &c) {
+  delete rsb;
+  rsb = new return_stack(c, state->icnt);
+}
+
+void simulation::setArgs(const char *filename, const std::string &sysArgs) {
+  int cnt = 0;
+  std::vector<std::string> args;
+  args.push_back(std::string(filename));
+
+  char *ptr = nullptr;
+  char *c_str = strdup(sysArgs.c_str());
+  if(sysArgs.size() != 0)
+    ptr = strtok(c_str, " ");
+
+  while(ptr && (cnt<MARGS)) {
+    args.push_back(std::string(ptr));
+    ptr = strtok(nullptr, " ");
+    cnt++;
+  }
+  sysArgv = new char*[args.size()];
+  for(size_t i = 0; i < args.size(); i++) {
+    const std::string & s = args[i];
+    size_t l = strlen(s.c_str());
+    sysArgv[i] = new char[l+1];
+    memset(sysArgv[i],0,sizeof(char)*(l+1));
+    memcpy(sysArgv[i],s.c_str(),sizeof(char)*l);
+  }
+  sysArgc = static_cast<int>(args.size());
+  free(c_str);
+}
+
+branch_predictor *simulation::addPredictor(const bpred_config &c) {
+  branch_predictor *bp = predictors.add(c, state->icnt);
+  if(bpred == nullptr) {
+    bpred = bp;
+  }
+  return bp;
+}
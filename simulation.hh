@@ -0,0 +1,47 @@
+#ifndef __SIMULATION_HH__
+#define __SIMULATION_HH__
+
+#include <cstdint>
+#include <string>
+
+#include "state.hh"
+#include "profileMips.hh"
+#include "branch_predictor.hh"
+#include "blockCache.hh"
+
+class simCache;
+class branchTraceWriter;
+class branch_target_buffer;
+class return_stack;
+struct rsb_config;
+
+/* everything one simulated program owns. nothing here is shared
+ * between simulations, so several can run in one process, each
+ * on its own thread. handlers reach it through state_t::sim */
+class simulation {
+public:
+  state_t *state = nullptr;
+  bool isMipsEL = false;
+  int sysArgc = 0;
+  char **sysArgv = nullptr;
+  /* clock seen by monitor calls when wall-clock is off */
+  timeval32_t myTimeVal = {0,0};
+  uint32_t myTime = 1<<20;
+  predictor_group predictors;
+  /* the first predictor, which is also charged jr $31 mispredicts */
+  branch_predictor *bpred = nullptr;
+  return_stack *rsb = nullptr;
+  branch_target_buffer *btb = nullptr;
+  simCache *L1D = nullptr;
+  branchTraceWriter *trace = nullptr;
+  blockCache bcache;
+  simulation();
+  ~simulation();
+  /* allocates register state and 4GB of guest memory */
+  bool init(uint64_t maxicnt);
+  void setRSB(const rsb_config &c);
+  void setArgs(const char *filename, const std::string &sysArgs);
+  branch_predictor *addPredictor(const bpred_config &c);
+};
+
+#endif
@@ -3,9 +3,13 @@
 
 #include <cstdint>
 
+class simulation;
+
 struct state_t {
   uint32_t pc;
   uint32_t last_pc;
+  /* where a branch or jump goes once its delay slot retires */
+  uint32_t br_target;
   int32_t gpr[32];
   int32_t lo;
   int32_t hi;
@@ -16,6 +20,8 @@ struct state_t {
   uint8_t *mem;
   uint8_t brk;
   uint64_t maxicnt;
+  /* the simulation this state belongs to */
+  simulation *sim;
 };
 
 #endif
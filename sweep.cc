@@ -0,0 +1,148 @@
+#include <algorithm>
+#include <cstdlib>
+#include <sstream>
+
+#include "sweep.hh"
+#include "threadPool.hh"
+
+std::vector<std::string> expandGrid(const std::string &spec) {
+  std::vector<std::string> out(1);
+  std::stringstream ss(spec);
+  std::string tok;
+  while(std::getline(ss, tok, ',')) {
+    size_t eq = tok.find('=');
+    std::string key = (eq == std::string::npos) ? "" : tok.substr(0, eq+1);
+    std::string vals = (eq == std::string::npos) ? tok : tok.substr(eq+1);
+    std::vector<std::string> alts;
+    std::stringstream vs(vals);
+    std::string v;
+    while(std::getline(vs, v, '/')) {
+      size_t colon = v.find(':');
+      /* paths keep their slashes */
+      if(key == "file=") {
+	alts.push_back(tok);
+	break;
+      }
+      if(key.empty() or (colon == std::string::npos)) {
+	alts.push_back(key + v);
+	continue;
+      }
+      uint64_t lo = strtoull(v.c_str(), nullptr, 0);
+      uint64_t hi = strtoull(v.c_str() + colon + 1, nullptr, 0);
+      for(uint64_t x = lo; x <= hi; x++) {
+	alts.push_back(key + std::to_string(x));
+      }
+    }
+    std::vector<std::string> next;
+    for(const std::string &prefix : out) {
+      for(const std::string &a : alts) {
+	next.push_back(prefix.empty() ? a : (prefix + "," + a));
+      }
+    }
+    out.swap(next);
+  }
+  return out;
+}
+
+static inline void replayRecord(predictor_group &g, const branch_record &r) {
+  if(r.kind == branch_kind::cond) {
+    g.branch(r.pc, r.taken);
+  }
+  else {
+    g.jump();
+  }
+}
+
+/* skips skip records, trains on warm more and then counts the
+ * next count records (or all of them when count is 0) */
+static void replayChunk(branchTraceCursor c, const bpred_config &config,
+			uint64_t skip, uint64_t warm, uint64_t count,
+			sweep_result &res) {
+  uint64_t icnt = 0, n_br = 0, n_mis = 0, n_insns = 0;
+  predictor_group g;
+  branch_predictor *bp = g.add(config, icnt);
+  branch_record r;
+  bool more = true;
+  for(uint64_t i = 0; more and (i < skip); i++) {
+    more = c.next(r);
+  }
+  for(uint64_t i = 0; more and (i < warm); i++) {
+    if((more = c.next(r))) {
+      replayRecord(g, r);
+    }
+  }
+  bp->get_stats(n_br, n_mis, n_insns);
+  uint64_t start_icnt = c.icnt();
+  for(uint64_t i = 0; more and ((count == 0) or (i < count)); i++) {
+    if((more = c.next(r))) {
+      replayRecord(g, r);
+    }
+  }
+  uint64_t end_icnt = more ? c.icnt() : r.icnt;
+  bp->get_stats(res.n_branches, res.n_mispredicts, n_insns);
+  res.n_branches -= n_br;
+  res.n_mispredicts -= n_mis;
+  res.n_insns = end_icnt - start_icnt;
+}
+
+std::vector<sweep_result> runSweep(const branchTraceReader &tr,
+				   const std::vector<bpred_config> &configs,
+				   size_t n_threads, uint64_t chunk_records,
+				   uint64_t warmup) {
+  std::vector<branchTraceCursor> chunks;
+  if(chunk_records == 0) {
+    chunks.push_back(tr.begin());
+  }
+  else {
+    chunks = tr.split(chunk_records);
+    warmup = std::min(warmup, chunk_records);
+  }
+  const size_t n_chunks = chunks.size();
+  std::vector<sweep_result> partial(configs.size() * n_chunks);
+  threadPool pool(n_threads);
+  for(size_t i = 0; i < configs.size(); i++) {
+    for(size_t k = 0; k < n_chunks; k++) {
+      sweep_result &res = partial[i*n_chunks + k];
+      const bpred_config &config = configs[i];
+      if(k == 0) {
+	pool.submit([&chunks, &config, &res, chunk_records]() {
+	    replayChunk(chunks[0], config, 0, 0, chunk_records, res);
+	  });
+      }
+      else {
+	pool.submit([&chunks, &config, &res, chunk_records, warmup, k]() {
+	    replayChunk(chunks[k-1], config, chunk_records - warmup,
+			warmup, chunk_records, res);
+	  });
+      }
+    }
+  }
+  pool.run();
+
+  std::vector<sweep_result> results(configs.size());
+  for(size_t i = 0; i < configs.size(); i++) {
+    for(size_t k = 0; k < n_chunks; k++) {
+      const sweep_result &p = partial[i*n_chunks + k];
+      results[i].n_branches += p.n_branches;
+      results[i].n_mispredicts += p.n_mispredicts;
+      results[i].n_insns += p.n_insns;
+    }
+  }
+  return results;
+}
+
+void writeSweep(std::ostream &out, const std::vector<bpred_config> &configs,
+		const std::vector<sweep_result> &results) {
+  out << "config,branches,mispredicts,insns,accuracy,mpki\n";
+  for(size_t i = 0; i < configs.size(); i++) {
+    const sweep_result &r = results[i];
+    double acc = static_cast<double>(r.n_branches - r.n_mispredicts) / r.n_branches;
+    double mpki = 1000.0 * static_cast<double>(r.n_mispredicts) / r.n_insns;
+    out << "\"" << configs[i].str() << "\","
+	<< r.n_branches << ","
+	<< r.n_mispredicts << ","
+	<< r.n_insns << ","
+	<< acc << ","
+	<< mpki << "\n";
+  }
+}
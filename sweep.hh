@@ -0,0 +1,38 @@
+#ifndef __SWEEP_HH__
+#define __SWEEP_HH__
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "branch_predictor.hh"
+#include "branchTrace.hh"
+
+/* expands a predictor config whose fields hold lists (a/b/c)
+ * or inclusive ranges (lo:hi) into every combination, e.g.
+ * "gshare/bimodal,lg_pht_sz=12:14" gives six configs */
+std::vector<std::string> expandGrid(const std::string &spec);
+
+struct sweep_result {
+  uint64_t n_branches = 0;
+  uint64_t n_mispredicts = 0;
+  uint64_t n_insns = 0;
+};
+
+/* replays one trace against every config on a pool of
+ * n_threads. chunk_records == 0 gives one job per config,
+ * which matches a serial replay exactly. otherwise each config
+ * is cut into jobs of chunk_records records, each preceded by
+ * up to warmup records that train the predictor but aren't
+ * counted, and the chunks are summed */
+std::vector<sweep_result> runSweep(const branchTraceReader &tr,
+				   const std::vector<bpred_config> &configs,
+				   size_t n_threads, uint64_t chunk_records,
+				   uint64_t warmup);
+
+/* one csv row per config */
+void writeSweep(std::ostream &out, const std::vector<bpred_config> &configs,
+		const std::vector<sweep_result> &results);
+
+#endif
@@ -0,0 +1,62 @@
+#include <thread>
+#include "threadPool.hh"
+
+threadPool::threadPool(size_t n_threads) : next_queue(0) {
+  if(n_threads == 0) {
+    n_threads = 1;
+  }
+  for(size_t i = 0; i < n_threads; i++) {
+    queues.emplace_back(new job_queue());
+  }
+}
+
+void threadPool::submit(std::function<void()> job) {
+  job_queue &q = *queues[next_queue];
+  next_queue = (next_queue + 1) % queues.size();
+  std::lock_guard<std::mutex> lk(q.m);
+  q.jobs.push_back(std::move(job));
+}
+
+bool threadPool::pop(size_t id, std::function<void()> &job) {
+  job_queue &q = *queues[id];
+  std::lock_guard<std::mutex> lk(q.m);
+  if(q.jobs.empty()) {
+    return false;
+  }
+  job = std::move(q.jobs.back());
+  q.jobs.pop_back();
+  return true;
+}
+
+bool threadPool::steal(size_t id, std::function<void()> &job) {
+  for(size_t i = 1; i < queues.size(); i++) {
+    job_queue &q = *queues[(id + i) % queues.size()];
+    std::lock_guard<std::mutex> lk(q.m);
+    if(not(q.jobs.empty())) {
+      job = std::move(q.jobs.front());
+      q.jobs.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+/* nothing is submitted while the pool runs, so a thread
+ * that finds every queue empty is done */
+void threadPool::worker(size_t id) {
+  std::function<void()> job;
+  while(pop(id, job) or steal(id, job)) {
+    job();
+  }
+}
+
+void threadPool::run() {
+  std::vector<std::thread> threads;
+  for(size_t i = 1; i < queues.size(); i++) {
+    threads.emplace_back(&threadPool::worker, this, i);
+  }
+  worker(0);
+  for(std::thread &t : threads) {
+    t.join();
+  }
+}
@@ -0,0 +1,35 @@
+#ifndef __THREAD_POOL_HH__
+#define __THREAD_POOL_HH__
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/* runs a fixed batch of jobs on n threads. jobs are dealt out
+ * round robin; each thread works from the back of its own queue
+ * and, once that runs dry, steals from the front of the others */
+class threadPool {
+private:
+  struct job_queue {
+    std::mutex m;
+    std::deque<std::function<void()>> jobs;
+  };
+  std::vector<std::unique_ptr<job_queue>> queues;
+  size_t next_queue;
+  bool pop(size_t id, std::function<void()> &job);
+  bool steal(size_t id, std::function<void()> &job);
+  void worker(size_t id);
+public:
+  threadPool(size_t n_threads);
+  size_t size() const {
+    return queues.size();
+  }
+  void submit(std::function<void()> job);
+  /* runs everything submitted so far and waits for it */
+  void run();
+};
+
+#endif